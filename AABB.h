@@ -9,4 +9,28 @@ struct AABB {
     glm::vec3 max;
 };
 
+inline bool Intersects(const AABB& a, const AABB& b) {
+    return !(a.max.x < b.min.x || a.min.x > b.max.x ||
+        a.max.y < b.min.y || a.min.y > b.max.y ||
+        a.max.z < b.min.z || a.min.z > b.max.z);
+}
+
+inline AABB Merge(const AABB& a, const AABB& b) {
+    return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
+
+inline glm::vec3 Center(const AABB& box) {
+    return (box.min + box.max) * 0.5f;
+}
+
+// Smallest world-space AABB around box after the affine transform matrix.
+inline AABB Transform(const AABB& box, const glm::mat4& matrix) {
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(box), 1.0f));
+    glm::vec3 extent = (box.max - box.min) * 0.5f;
+    glm::vec3 worldExtent = glm::abs(glm::vec3(matrix[0])) * extent.x +
+        glm::abs(glm::vec3(matrix[1])) * extent.y +
+        glm::abs(glm::vec3(matrix[2])) * extent.z;
+    return { center - worldExtent, center + worldExtent };
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,216 @@
+#ifndef AABB_SOA_H
+#define AABB_SOA_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+
+#include <vector>
+#include <cfloat>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AABB_SOA_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(AABB_SOA_X86) && defined(__GNUC__)
+#define AABB_SOA_TARGET_AVX __attribute__((target("avx")))
+#else
+#define AABB_SOA_TARGET_AVX
+#endif
+
+// Structure-of-arrays box store: separate min/max arrays per axis, padded with
+// empty boxes so SIMD kernels can always load 8 lanes from any start index.
+class AABBSoA
+{
+public:
+    static const size_t LANES = 8;
+
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    void Clear()
+    {
+        count = 0;
+        minX.clear(); minY.clear(); minZ.clear();
+        maxX.clear(); maxY.clear(); maxZ.clear();
+    }
+
+    void Add(const AABB& box)
+    {
+        Resize(count + 1);
+        minX[count] = box.min.x; minY[count] = box.min.y; minZ[count] = box.min.z;
+        maxX[count] = box.max.x; maxY[count] = box.max.y; maxZ[count] = box.max.z;
+        count++;
+    }
+
+    void Assign(const std::vector<AABB>& boxes)
+    {
+        count = 0;
+        Resize(boxes.size());
+        for (const auto& box : boxes)
+            Add(box);
+    }
+
+    size_t Size() const { return count; }
+
+    AABB Get(size_t index) const
+    {
+        return { glm::vec3(minX[index], minY[index], minZ[index]), glm::vec3(maxX[index], maxY[index], maxZ[index]) };
+    }
+
+    // Writes the indices in [first, first + rangeCount) whose boxes overlap query
+    // into hits (room for rangeCount entries) and returns how many were written.
+    size_t Overlaps(const AABB& query, size_t first, size_t rangeCount, uint32_t* hits) const
+    {
+        return SelectKernel()(*this, query, first, rangeCount, hits);
+    }
+
+    bool AnyOverlap(const AABB& query, size_t first, size_t rangeCount) const
+    {
+        const size_t BLOCK = 32 * LANES;
+        uint32_t hits[BLOCK];
+        for (size_t i = first; i < first + rangeCount; i += BLOCK) {
+            size_t block = first + rangeCount - i < BLOCK ? first + rangeCount - i : BLOCK;
+            if (Overlaps(query, i, block, hits) > 0)
+                return true;
+        }
+        return false;
+    }
+
+    typedef size_t(*OverlapKernel)(const AABBSoA&, const AABB&, size_t, size_t, uint32_t*);
+
+    static size_t OverlapsScalar(const AABBSoA& s, const AABB& q, size_t first, size_t rangeCount, uint32_t* hits)
+    {
+        size_t n = 0;
+        for (size_t i = first; i < first + rangeCount; i++) {
+            bool separated = s.maxX[i] < q.min.x || s.minX[i] > q.max.x ||
+                s.maxY[i] < q.min.y || s.minY[i] > q.max.y ||
+                s.maxZ[i] < q.min.z || s.minZ[i] > q.max.z;
+            hits[n] = static_cast<uint32_t>(i);
+            n += separated ? 0 : 1;
+        }
+        return n;
+    }
+
+#ifdef AABB_SOA_X86
+    static size_t OverlapsSSE(const AABBSoA& s, const AABB& q, size_t first, size_t rangeCount, uint32_t* hits)
+    {
+        const __m128 qMinX = _mm_set1_ps(q.min.x), qMinY = _mm_set1_ps(q.min.y), qMinZ = _mm_set1_ps(q.min.z);
+        const __m128 qMaxX = _mm_set1_ps(q.max.x), qMaxY = _mm_set1_ps(q.max.y), qMaxZ = _mm_set1_ps(q.max.z);
+        size_t n = 0;
+        for (size_t i = first; i < first + rangeCount; i += 4) {
+            __m128 separated = _mm_or_ps(
+                _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&s.maxX[i]), qMinX), _mm_cmpgt_ps(_mm_loadu_ps(&s.minX[i]), qMaxX)),
+                _mm_or_ps(
+                    _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&s.maxY[i]), qMinY), _mm_cmpgt_ps(_mm_loadu_ps(&s.minY[i]), qMaxY)),
+                    _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(&s.maxZ[i]), qMinZ), _mm_cmpgt_ps(_mm_loadu_ps(&s.minZ[i]), qMaxZ))));
+            unsigned mask = ~static_cast<unsigned>(_mm_movemask_ps(separated)) & TailMask(first + rangeCount - i, 4);
+            n += WriteHits(mask, i, hits + n);
+        }
+        return n;
+    }
+
+    AABB_SOA_TARGET_AVX
+    static size_t OverlapsAVX(const AABBSoA& s, const AABB& q, size_t first, size_t rangeCount, uint32_t* hits)
+    {
+        const __m256 qMinX = _mm256_set1_ps(q.min.x), qMinY = _mm256_set1_ps(q.min.y), qMinZ = _mm256_set1_ps(q.min.z);
+        const __m256 qMaxX = _mm256_set1_ps(q.max.x), qMaxY = _mm256_set1_ps(q.max.y), qMaxZ = _mm256_set1_ps(q.max.z);
+        size_t n = 0;
+        for (size_t i = first; i < first + rangeCount; i += 8) {
+            __m256 separated = _mm256_or_ps(
+                _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s.maxX[i]), qMinX, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&s.minX[i]), qMaxX, _CMP_GT_OQ)),
+                _mm256_or_ps(
+                    _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s.maxY[i]), qMinY, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&s.minY[i]), qMaxY, _CMP_GT_OQ)),
+                    _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(&s.maxZ[i]), qMinZ, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_loadu_ps(&s.minZ[i]), qMaxZ, _CMP_GT_OQ))));
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_ps(separated)) & TailMask(first + rangeCount - i, 8);
+            n += WriteHits(mask, i, hits + n);
+        }
+        return n;
+    }
+#endif
+
+    // Picks the widest kernel the CPU supports, once per process.
+    static OverlapKernel SelectKernel()
+    {
+        static const OverlapKernel kernel = DetectKernel();
+        return kernel;
+    }
+
+    static const char* KernelName()
+    {
+#ifdef AABB_SOA_X86
+        if (SelectKernel() == &OverlapsAVX) return "avx";
+        if (SelectKernel() == &OverlapsSSE) return "sse";
+#endif
+        return "scalar";
+    }
+
+    static bool CpuHasAVX()
+    {
+#ifdef AABB_SOA_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx");
+#endif
+#else
+        return false;
+#endif
+    }
+
+    // Helpers shared with other kernels that run over the packed boxes.
+    static unsigned TailMask(size_t remaining, size_t lanes)
+    {
+        return remaining >= lanes ? (1u << lanes) - 1u : (1u << remaining) - 1u;
+    }
+
+    static size_t WriteHits(unsigned mask, size_t base, uint32_t* hits)
+    {
+        size_t n = 0;
+        while (mask) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+#else
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+            hits[n++] = static_cast<uint32_t>(base + bit);
+            mask &= mask - 1;
+        }
+        return n;
+    }
+
+private:
+    size_t count = 0;
+
+    void Resize(size_t newCount)
+    {
+        // Round up to whole blocks plus one extra block for unaligned starts.
+        size_t padded = ((newCount + LANES - 1) / LANES + 1) * LANES;
+        if (minX.size() >= padded)
+            return;
+        minX.resize(padded, FLT_MAX); minY.resize(padded, FLT_MAX); minZ.resize(padded, FLT_MAX);
+        maxX.resize(padded, -FLT_MAX); maxY.resize(padded, -FLT_MAX); maxZ.resize(padded, -FLT_MAX);
+    }
+
+    static OverlapKernel DetectKernel()
+    {
+#ifdef AABB_SOA_X86
+        if (CpuHasAVX())
+            return &OverlapsAVX;
+        return &OverlapsSSE;
+#else
+        return &OverlapsScalar;
+#endif
+    }
+};
+#endif
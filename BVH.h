@@ -0,0 +1,162 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+// Static bounding volume hierarchy over a set of boxes.
+// Built once, then answers overlap queries without touching every box.
+class BVH
+{
+public:
+    struct Node {
+        AABB bounds;
+        int left;       // index of the first child, -1 for leaves
+        int first;      // first entry in primitiveIndices (leaves only)
+        int count;      // number of primitives (leaves only)
+    };
+
+    // One SIMD block of boxes per leaf.
+    static const int MAX_LEAF_SIZE = 8;
+
+    void Build(const std::vector<AABB>& boxes)
+    {
+        nodes.clear();
+        primitiveIndices.clear();
+        primitiveBoxes = boxes;
+        if (boxes.empty())
+            return;
+
+        centers.resize(boxes.size());
+        primitiveIndices.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            centers[i] = Center(boxes[i]);
+            primitiveIndices[i] = static_cast<int>(i);
+        }
+
+        nodes.reserve(boxes.size() * 2);
+        nodes.push_back(Node());
+        BuildNode(0, 0, static_cast<int>(boxes.size()));
+
+        centers.clear();
+        centers.shrink_to_fit();
+
+        // Leaf boxes packed in traversal order so each leaf is one contiguous SoA range.
+        leafBoxes.Clear();
+        for (int index : primitiveIndices)
+            leafBoxes.Add(primitiveBoxes[index]);
+    }
+
+    bool Empty() const { return nodes.empty(); }
+
+    const AABB& GetBounds() const { return nodes[0].bounds; }
+
+    const AABB& GetPrimitiveBox(int index) const { return primitiveBoxes[index]; }
+
+    size_t GetPrimitiveCount() const { return primitiveBoxes.size(); }
+
+    // True as soon as any primitive box overlaps the query box.
+    bool Overlaps(const AABB& box) const
+    {
+        bool hit = false;
+        Traverse(box, [&](int) {
+            hit = true;
+            return false;
+        });
+        return hit;
+    }
+
+    // Appends the indices of every primitive whose box overlaps the query box.
+    void Query(const AABB& box, std::vector<int>& result) const
+    {
+        Traverse(box, [&](int index) {
+            result.push_back(index);
+            return true;
+        });
+    }
+
+    // Calls visitor(primitiveIndex) for overlapping primitives until it returns false.
+    template <typename Visitor>
+    void Traverse(const AABB& box, Visitor visitor) const
+    {
+        if (nodes.empty() || !Intersects(nodes[0].bounds, box))
+            return;
+
+        int stack[64];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize > 0) {
+            const Node& node = nodes[stack[--stackSize]];
+            if (node.left < 0) {
+                uint32_t hits[MAX_LEAF_SIZE];
+                size_t hitCount = leafBoxes.Overlaps(box, node.first, node.count, hits);
+                for (size_t i = 0; i < hitCount; i++) {
+                    if (!visitor(primitiveIndices[hits[i]]))
+                        return;
+                }
+                continue;
+            }
+            if (Intersects(nodes[node.left].bounds, box))
+                stack[stackSize++] = node.left;
+            if (Intersects(nodes[node.left + 1].bounds, box))
+                stack[stackSize++] = node.left + 1;
+        }
+    }
+
+private:
+    std::vector<Node> nodes;
+    std::vector<int> primitiveIndices;
+    std::vector<AABB> primitiveBoxes;
+    AABBSoA leafBoxes;
+    std::vector<glm::vec3> centers;
+
+    void BuildNode(int nodeIndex, int first, int count)
+    {
+        AABB bounds = primitiveBoxes[primitiveIndices[first]];
+        AABB centerBounds = { centers[primitiveIndices[first]], centers[primitiveIndices[first]] };
+        for (int i = first + 1; i < first + count; i++) {
+            int index = primitiveIndices[i];
+            bounds = Merge(bounds, primitiveBoxes[index]);
+            centerBounds.min = glm::min(centerBounds.min, centers[index]);
+            centerBounds.max = glm::max(centerBounds.max, centers[index]);
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        glm::vec3 extent = centerBounds.max - centerBounds.min;
+        int axis = 0;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+
+        if (count <= MAX_LEAF_SIZE) {
+            nodes[nodeIndex].left = -1;
+            nodes[nodeIndex].first = first;
+            nodes[nodeIndex].count = count;
+            return;
+        }
+
+        // Median split keeps the depth logarithmic, so the traversal stack never overflows.
+        // Coincident centers are simply halved in their current order.
+        int mid = first + count / 2;
+        if (extent[axis] > 0.0f) {
+            std::nth_element(primitiveIndices.begin() + first, primitiveIndices.begin() + mid,
+                primitiveIndices.begin() + first + count,
+                [&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+        }
+
+        int left = static_cast<int>(nodes.size());
+        nodes[nodeIndex].left = left;
+        nodes[nodeIndex].first = 0;
+        nodes[nodeIndex].count = 0;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        BuildNode(left, first, mid - first);
+        BuildNode(left + 1, mid, first + count - mid);
+    }
+};
+#endif
@@ -0,0 +1,86 @@
+#ifndef BROADPHASE_BENCHMARK_H
+#define BROADPHASE_BENCHMARK_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "CollisionWorld.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+
+// Compares linear scan, BVH and grid broadphase on synthetic maze walls.
+// Run with: LabirintGL --bench-broadphase
+class BroadphaseBenchmark
+{
+public:
+    static constexpr float WALL_LENGTH = 24.0f;
+    static constexpr float WALL_THICKNESS = 2.0f;
+    static constexpr float WALL_HEIGHT = 40.0f;
+    static constexpr int QUERY_COUNT = 20000;
+
+    // Thin axis-aligned walls on a square grid, about one per maze cell like labyrinth5.obj.
+    static std::vector<AABB> GenerateWalls(int count, std::mt19937& gen)
+    {
+        int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+        std::uniform_int_distribution<int> orientation(0, 1);
+        std::vector<AABB> walls;
+        walls.reserve(count);
+        for (int i = 0; i < count; i++) {
+            glm::vec3 origin((i % side) * WALL_LENGTH, -25.0f, (i / side) * WALL_LENGTH);
+            glm::vec3 size = orientation(gen) ?
+                glm::vec3(WALL_LENGTH, WALL_HEIGHT, WALL_THICKNESS) :
+                glm::vec3(WALL_THICKNESS, WALL_HEIGHT, WALL_LENGTH);
+            walls.push_back({ origin, origin + size });
+        }
+        return walls;
+    }
+
+    static double TimeQueries(const CollisionWorld& world, const std::vector<AABB>& queries, int& hits)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        hits = 0;
+        for (const auto& query : queries)
+            hits += world.Overlaps(query) ? 1 : 0;
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+    }
+
+    static void Run()
+    {
+        const int wallCounts[] = { 1000, 10000, 100000 };
+        const char* names[] = { "linear", "bvh", "grid" };
+
+        std::printf("box kernel: %s\n", AABBSoA::KernelName());
+        std::printf("%8s %10s %12s %12s %12s\n", "walls", "queries", names[0], names[1], names[2]);
+        for (int wallCount : wallCounts) {
+            std::mt19937 gen(1234);
+            CollisionWorld world;
+            world.AddBoxes(GenerateWalls(wallCount, gen));
+
+            float extent = std::ceil(std::sqrt(static_cast<float>(wallCount))) * WALL_LENGTH;
+            std::uniform_real_distribution<float> coord(0.0f, extent);
+            std::vector<AABB> queries;
+            queries.reserve(QUERY_COUNT);
+            for (int i = 0; i < QUERY_COUNT; i++) {
+                glm::vec3 position(coord(gen), 7.0f, coord(gen));
+                queries.push_back({ position - glm::vec3(0.6f, 1.0f, 0.6f), position + glm::vec3(0.6f, 2.0f, 0.6f) });
+            }
+
+            double timings[3];
+            int hits[3];
+            const Broadphase types[] = { BROADPHASE_LINEAR, BROADPHASE_BVH, BROADPHASE_GRID };
+            for (int i = 0; i < 3; i++) {
+                world.Build(types[i]);
+                timings[i] = TimeQueries(world, queries, hits[i]);
+            }
+
+            std::printf("%8d %10d %9.1f ns %9.1f ns %9.1f ns\n", wallCount, QUERY_COUNT, timings[0], timings[1], timings[2]);
+            if (hits[0] != hits[1] || hits[0] != hits[2])
+                std::printf("  mismatch: linear %d, bvh %d, grid %d hits\n", hits[0], hits[1], hits[2]);
+        }
+    }
+};
+#endif
@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "AABB.h"
+#include "CollisionWorld.h"
 #include <vector>
 
 enum Camera_Movement {
@@ -30,6 +31,7 @@ class Camera
 public:
 
     glm::vec3 Position;
+    glm::vec3 PreviousPosition;     // position at the start of the current simulation tick
     glm::vec3 Front;
     glm::vec3 Up;
     glm::vec3 Right;
@@ -60,6 +62,9 @@ public:
     bool isMoving = false;         
     glm::vec3 basePosition;         
 
+    // Same footprint as the old collision box: 0.6 wide, from 1 below to 2 above the eye.
+    Capsule BodyCapsule = { 0.6f, -0.4f, 1.4f };
+
     struct {
         bool isActive = false;
         float timer = 0.0f;
@@ -75,6 +80,7 @@ public:
         IsJumping(false), VelocityY(0.0f), moveForward(false), moveBackward(false), moveLeft(false), moveRight(false), CanChangeDirection(true)
     {
         Position = position;
+        PreviousPosition = position;
         WorldUp = up;
         Yaw = yaw;
         Pitch = pitch;
@@ -85,13 +91,19 @@ public:
         : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM), IsJumping(false), VelocityY(0.0f)
     {
         Position = glm::vec3(posX, posY, posZ);
+        PreviousPosition = Position;
         WorldUp = glm::vec3(upX, upY, upZ);
         Yaw = yaw;
         Pitch = pitch;
         updateCameraVectors();
     }
 
-    glm::mat4 GetViewMatrix()
+    glm::mat4 GetViewMatrix() const
+    {
+        return GetViewMatrix(Position);
+    }
+
+    glm::mat4 GetViewMatrix(const glm::vec3& eye) const
     {
         float tiltAngle = 0.0f;
         if (isMoving) {
@@ -102,7 +114,7 @@ public:
 
         glm::vec3 tiltedUp = glm::vec3(tilt * glm::vec4(Up, 0.0f));
 
-        return glm::lookAt(Position, Position + Front, tiltedUp);
+        return glm::lookAt(eye, eye + Front, tiltedUp);
     }
     void ProcessKeyboard(Camera_Movement direction, bool pressed) {
         if (IsJumping) return;
@@ -122,7 +134,7 @@ public:
         }
     }
 
-    void UpdatePosition(float deltaTime, const std::vector<AABB>& meshesAABB) {
+    void UpdatePosition(float deltaTime, const CollisionWorld& world) {
 
 
         if (!isMoving) {
@@ -142,46 +154,7 @@ public:
 
         if (glm::length(moveDirection) > 0.0f) {
             moveDirection = glm::normalize(moveDirection);
-            glm::vec3 newPosition = Position + moveDirection * velocity;
-
-            if (IsJumping) {
-                velocity *= 0.0f;
-            }
-
-            bool collisionDetected = false;
-            for (const auto& aabb : meshesAABB) {
-                if (CheckCollision(newPosition, aabb)) {
-                    collisionDetected = true;
-                    break;
-                }
-            }
-
-            if (!collisionDetected) {
-                Position = newPosition;
-            }
-            else {
-                glm::vec3 tempPosition = Position;
-                tempPosition.x = newPosition.x;
-                bool collisionX = false;
-                for (const auto& aabb : meshesAABB) {
-                    if (CheckCollision(tempPosition, aabb)) {
-                        collisionX = true;
-                        break;
-                    }
-                }
-                if (!collisionX) Position.x = newPosition.x;
-
-                tempPosition = Position;
-                tempPosition.z = newPosition.z;
-                bool collisionZ = false;
-                for (const auto& aabb : meshesAABB) {
-                    if (CheckCollision(tempPosition, aabb)) {
-                        collisionZ = true;
-                        break;
-                    }
-                }
-                if (!collisionZ) Position.z = newPosition.z;
-            }
+            Position = world.MoveCapsule(Position, moveDirection * velocity, BodyCapsule);
         }
         if (isMoving && !IsJumping) {
             walkBobTimer += deltaTime * walkBobSpeed;
@@ -246,8 +219,20 @@ public:
 
     void SetPosition(const glm::vec3& newPos) {
         Position = newPos;
+        PreviousPosition = newPos;
         basePosition = newPos;
     }
+
+    void SetOrientation(float yaw, float pitch) {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
+    // Render-time position between the last two simulation ticks, alpha in [0, 1].
+    glm::vec3 GetInterpolatedPosition(float alpha) const {
+        return glm::mix(PreviousPosition, Position, alpha);
+    }
     void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
     {
         if (neckAnimation.isActive) return;
@@ -309,14 +294,6 @@ public:
     }
 
 private:
-    bool CheckCollision(const glm::vec3& newPosition, const AABB& aabb) const {
-        AABB cameraAABB;
-        cameraAABB.min = newPosition - glm::vec3(0.6f, 1.0f, 0.6f);
-        cameraAABB.max = newPosition + glm::vec3(0.6f, 2.0f, 0.6f);
-        return !(cameraAABB.max.x < aabb.min.x || cameraAABB.min.x > aabb.max.x ||
-            cameraAABB.max.y < aabb.min.y || cameraAABB.min.y > aabb.max.y ||
-            cameraAABB.max.z < aabb.min.z || cameraAABB.min.z > aabb.max.z);
-    }
     void updateCameraVectors()
     {
         glm::vec3 front;
@@ -0,0 +1,184 @@
+#ifndef COLLISION_GEOMETRY_H
+#define COLLISION_GEOMETRY_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cfloat>
+
+// Vertical capsule relative to the character position: a segment from
+// position.y + bottom to position.y + top, inflated by radius.
+struct Capsule {
+    float radius;
+    float bottom;
+    float top;
+};
+
+inline glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 ap = p - a;
+    float d1 = glm::dot(ab, ap);
+    float d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp);
+    float d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp);
+    float d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Closest points between segments p1q1 and p2q2, returns the squared distance.
+inline float ClosestPointsSegmentSegment(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+    glm::vec3& c1, glm::vec3& c2)
+{
+    const float EPSILON = 1e-8f;
+    glm::vec3 d1 = q1 - p1;
+    glm::vec3 d2 = q2 - p2;
+    glm::vec3 r = p1 - p2;
+    float a = glm::dot(d1, d1);
+    float e = glm::dot(d2, d2);
+    float f = glm::dot(d2, r);
+    float s = 0.0f, t = 0.0f;
+
+    if (a <= EPSILON && e <= EPSILON) {
+        c1 = p1;
+        c2 = p2;
+        return glm::dot(c1 - c2, c1 - c2);
+    }
+    if (a <= EPSILON) {
+        t = glm::clamp(f / e, 0.0f, 1.0f);
+    }
+    else {
+        float c = glm::dot(d1, r);
+        if (e <= EPSILON) {
+            s = glm::clamp(-c / a, 0.0f, 1.0f);
+        }
+        else {
+            float b = glm::dot(d1, d2);
+            float denom = a * e - b * b;
+            s = denom != 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+            t = (b * s + f) / e;
+            if (t < 0.0f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            }
+            else if (t > 1.0f) {
+                t = 1.0f;
+                s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+            }
+        }
+    }
+    c1 = p1 + d1 * s;
+    c2 = p2 + d2 * t;
+    return glm::dot(c1 - c2, c1 - c2);
+}
+
+inline bool SegmentIntersectsTriangle(const glm::vec3& p, const glm::vec3& q,
+    const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, glm::vec3& point)
+{
+    glm::vec3 ab = b - a;
+    glm::vec3 ac = c - a;
+    glm::vec3 qp = p - q;
+    glm::vec3 n = glm::cross(ab, ac);
+    float d = glm::dot(qp, n);
+    if (std::fabs(d) < 1e-12f) return false;
+
+    glm::vec3 ap = p - a;
+    float t = glm::dot(ap, n) / d;
+    if (t < 0.0f || t > 1.0f) return false;
+
+    glm::vec3 e = glm::cross(qp, ap);
+    float v = glm::dot(ac, e) / d;
+    if (v < 0.0f || v > 1.0f) return false;
+    float w = -glm::dot(ab, e) / d;
+    if (w < 0.0f || v + w > 1.0f) return false;
+
+    point = p + (q - p) * t;
+    return true;
+}
+
+// Squared distance between segment pq and triangle abc with the closest points on each.
+inline float SegmentTriangleDistance(const glm::vec3& p, const glm::vec3& q,
+    const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+    glm::vec3& onSegment, glm::vec3& onTriangle)
+{
+    glm::vec3 hit;
+    if (SegmentIntersectsTriangle(p, q, a, b, c, hit)) {
+        onSegment = onTriangle = hit;
+        return 0.0f;
+    }
+
+    float best = FLT_MAX;
+    glm::vec3 s, t;
+    const glm::vec3 edges[3][2] = { { a, b }, { b, c }, { c, a } };
+    for (const auto& edge : edges) {
+        float d = ClosestPointsSegmentSegment(p, q, edge[0], edge[1], s, t);
+        if (d < best) { best = d; onSegment = s; onTriangle = t; }
+    }
+    t = ClosestPointOnTriangle(p, a, b, c);
+    float d = glm::dot(p - t, p - t);
+    if (d < best) { best = d; onSegment = p; onTriangle = t; }
+    t = ClosestPointOnTriangle(q, a, b, c);
+    d = glm::dot(q - t, q - t);
+    if (d < best) { best = d; onSegment = q; onTriangle = t; }
+    return best;
+}
+
+// Time of impact in [0, 1] of capsule segment pq, inflated by radius, moving by
+// displacement against triangle abc. Uses conservative advancement, so the
+// capsule stops at least skin/2 away from the surface and never tunnels.
+// Returns false when there is no contact along the path or the capsule already
+// touches the triangle but is moving away from it.
+inline bool SweepCapsuleTriangle(const glm::vec3& p, const glm::vec3& q, float radius, const glm::vec3& displacement,
+    const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float skin, float& toi, glm::vec3& normal)
+{
+    const int MAX_ITERATIONS = 16;
+    float length = glm::length(displacement);
+    if (length <= 0.0f) return false;
+
+    float t = 0.0f;
+    for (int i = 0; i < MAX_ITERATIONS; i++) {
+        glm::vec3 offset = displacement * t;
+        glm::vec3 onSegment, onTriangle;
+        float distance = std::sqrt(SegmentTriangleDistance(p + offset, q + offset, a, b, c, onSegment, onTriangle));
+        float gap = distance - radius;
+
+        if (gap <= skin || i == MAX_ITERATIONS - 1) {
+            if (distance > 1e-5f) {
+                normal = (onSegment - onTriangle) / distance;
+            }
+            else {
+                normal = glm::normalize(glm::cross(b - a, c - a));
+                if (glm::dot(normal, displacement) > 0.0f) normal = -normal;
+            }
+            if (glm::dot(normal, displacement) >= -1e-3f * length) return false;
+            toi = t;
+            return true;
+        }
+
+        t += (gap - skin * 0.5f) / length;
+        if (t > 1.0f) return false;
+    }
+    return false;
+}
+#endif
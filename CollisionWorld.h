@@ -0,0 +1,154 @@
+#ifndef COLLISION_WORLD_H
+#define COLLISION_WORLD_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "BVH.h"
+#include "SpatialGrid.h"
+#include "CollisionGeometry.h"
+
+#include <vector>
+#include <algorithm>
+
+enum Broadphase {
+    BROADPHASE_LINEAR,
+    BROADPHASE_BVH,
+    BROADPHASE_GRID
+};
+
+// Static level geometry used for movement queries, collected once after the
+// models are loaded; Build() is called a single time.
+// Movement only sweeps against the triangles. The box broadphase (Overlaps,
+// Query) is what --bench-broadphase measures; the game adds no boxes.
+class CollisionWorld
+{
+public:
+    void AddBox(const AABB& box)
+    {
+        boxes.push_back(box);
+    }
+
+    void AddBoxes(const std::vector<AABB>& newBoxes)
+    {
+        boxes.insert(boxes.end(), newBoxes.begin(), newBoxes.end());
+    }
+
+    // Three corners per triangle, already in world space.
+    void AddTriangles(const std::vector<glm::vec3>& corners)
+    {
+        triangles.insert(triangles.end(), corners.begin(), corners.end());
+    }
+
+    void Build(Broadphase type = BROADPHASE_LINEAR, float gridCellSize = 0.0f)
+    {
+        std::vector<AABB> triangleBoxes;
+        triangleBoxes.reserve(triangles.size() / 3);
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            AABB box = { triangles[i], triangles[i] };
+            box = Merge(box, { triangles[i + 1], triangles[i + 1] });
+            box = Merge(box, { triangles[i + 2], triangles[i + 2] });
+            triangleBoxes.push_back(box);
+        }
+        triangleBVH.Build(triangleBoxes);
+
+        broadphase = type;
+        packedBoxes.Assign(boxes);
+        if (broadphase == BROADPHASE_BVH)
+            bvh.Build(boxes);
+        else if (broadphase == BROADPHASE_GRID)
+            grid.Build(boxes, gridCellSize);
+    }
+
+    bool Overlaps(const AABB& box) const
+    {
+        switch (broadphase) {
+        case BROADPHASE_BVH:  return bvh.Overlaps(box);
+        case BROADPHASE_GRID: return grid.Overlaps(box);
+        default:   return packedBoxes.AnyOverlap(box, 0, packedBoxes.Size());
+        }
+    }
+
+    void Query(const AABB& box, std::vector<int>& result) const
+    {
+        switch (broadphase) {
+        case BROADPHASE_BVH:  bvh.Query(box, result); break;
+        case BROADPHASE_GRID: grid.Query(box, result); break;
+        default: {
+            uint32_t hits[AABBSoA::LANES];
+            for (size_t i = 0; i < packedBoxes.Size(); i += AABBSoA::LANES) {
+                size_t block = std::min(AABBSoA::LANES, packedBoxes.Size() - i);
+                size_t hitCount = packedBoxes.Overlaps(box, i, block, hits);
+                result.insert(result.end(), hits, hits + hitCount);
+            }
+            break;
+        }
+        }
+    }
+
+    // Moves a capsule by displacement against the triangle geometry in a single
+    // swept query per slide step, sliding along whatever it hits.
+    glm::vec3 MoveCapsule(const glm::vec3& position, const glm::vec3& displacement, const Capsule& capsule) const
+    {
+        const int MAX_SLIDES = 3;
+        const float SKIN = 0.01f;
+
+        glm::vec3 current = position;
+        glm::vec3 remaining = displacement;
+        for (int slide = 0; slide < MAX_SLIDES; slide++) {
+            float length = glm::length(remaining);
+            if (length < 1e-5f || triangleBVH.Empty())
+                break;
+
+            glm::vec3 p = current + glm::vec3(0.0f, capsule.bottom, 0.0f);
+            glm::vec3 q = current + glm::vec3(0.0f, capsule.top, 0.0f);
+            glm::vec3 inflate(capsule.radius + SKIN);
+            AABB sweptBox = { glm::min(p, p + remaining) - inflate, glm::max(q, q + remaining) + inflate };
+
+            float nearest = 1.0f;
+            glm::vec3 contactNormal(0.0f);
+            bool hit = false;
+            triangleBVH.Traverse(sweptBox, [&](int index) {
+                float toi;
+                glm::vec3 normal;
+                const glm::vec3* corner = &triangles[index * 3];
+                if (SweepCapsuleTriangle(p, q, capsule.radius, remaining, corner[0], corner[1], corner[2], SKIN, toi, normal)
+                    && toi <= nearest) {
+                    nearest = toi;
+                    contactNormal = normal;
+                    hit = true;
+                }
+                return true;
+            });
+
+            if (!hit) {
+                current += remaining;
+                break;
+            }
+
+            current += remaining * nearest;
+            remaining *= 1.0f - nearest;
+
+            // The controller only moves horizontally, so slide along the wall's horizontal normal.
+            contactNormal.y = 0.0f;
+            if (glm::length(contactNormal) < 1e-3f)
+                break;
+            contactNormal = glm::normalize(contactNormal);
+            remaining -= contactNormal * glm::dot(remaining, contactNormal);
+        }
+        return current;
+    }
+
+    Broadphase GetBroadphase() const { return broadphase; }
+
+    const std::vector<AABB>& GetBoxes() const { return boxes; }
+
+private:
+    std::vector<AABB> boxes;
+    AABBSoA packedBoxes;
+    std::vector<glm::vec3> triangles;
+    BVH triangleBVH;
+    Broadphase broadphase = BROADPHASE_LINEAR;
+    BVH bvh;
+    SpatialGrid grid;
+};
+#endif
@@ -0,0 +1,82 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+
+// GPU time per render pass from GL_TIME_ELAPSED queries, plus the whole frame
+// as measured on the CPU. Results are read back at the end of each frame, which
+// stalls until the GPU is done, so this is meant for benchmark runs only.
+class FrameProfiler
+{
+public:
+    explicit FrameProfiler(const std::vector<std::string>& names)
+        : passNames(names), queries(names.size()), used(names.size(), false), samples(names.size() + 1)
+    {
+        glGenQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    ~FrameProfiler()
+    {
+        glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+    }
+
+    void BeginPass(int pass)
+    {
+        glBeginQuery(GL_TIME_ELAPSED, queries[pass]);
+        used[pass] = true;
+    }
+
+    void EndPass()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    void EndFrame(double frameMilliseconds)
+    {
+        for (size_t i = 0; i < queries.size(); i++) {
+            GLuint64 nanoseconds = 0;
+            if (used[i])
+                glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            samples[i].push_back(nanoseconds / 1.0e6);
+            used[i] = false;
+        }
+        samples.back().push_back(frameMilliseconds);
+    }
+
+    void Print() const
+    {
+        std::printf("%-14s %9s %9s %9s %9s\n", "pass", "min ms", "avg ms", "p95 ms", "p99 ms");
+        for (size_t i = 0; i < samples.size(); i++)
+            PrintRow(i < passNames.size() ? passNames[i].c_str() : "frame", samples[i]);
+    }
+
+private:
+    std::vector<std::string> passNames;
+    std::vector<GLuint> queries;
+    std::vector<bool> used;
+    std::vector<std::vector<double>> samples;  // one list per pass, the whole frame last
+
+    static void PrintRow(const char* name, std::vector<double> values)
+    {
+        if (values.empty())
+            return;
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (double value : values)
+            sum += value;
+        std::printf("%-14s %9.3f %9.3f %9.3f %9.3f\n", name, values.front(), sum / values.size(),
+            Percentile(values, 0.95), Percentile(values, 0.99));
+    }
+
+    static double Percentile(const std::vector<double>& sorted, double fraction)
+    {
+        size_t rank = static_cast<size_t>(fraction * sorted.size() + 0.999999);
+        return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+    }
+};
+#endif
@@ -0,0 +1,108 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+
+// CPU mirrors of the std140 uniform blocks shared by the shaders. Every vec3
+// is followed by a float so the layout matches std140 without hidden padding.
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 skyboxView;          // view without translation
+    glm::mat4 lightSpaceMatrix;
+    glm::vec3 viewPos;
+    float padding0;
+};
+
+struct SpotLightData {
+    glm::vec3 position;
+    float constant;
+    glm::vec3 direction;
+    float linear;
+    glm::vec3 ambient;
+    float quadratic;
+    glm::vec3 diffuse;
+    float cutOff;                  // cosine
+    glm::vec3 specular;
+    float outerCutOff;             // cosine
+    int state;                     // GLSL bool is 4 bytes in std140
+    float padding0[3];
+};
+
+enum UniformBlockBinding {
+    FRAME_DATA_BINDING,
+    SPOT_LIGHT_BINDING,
+    UNIFORM_BLOCK_COUNT
+};
+
+// Per-frame uniform blocks in one buffer split into RING_SIZE segments. Each
+// frame writes the next segment, so the CPU never overwrites data the GPU may
+// still be reading; a fence per segment guards the wrap-around.
+class FrameUniforms
+{
+public:
+    static const int RING_SIZE = 3;
+
+    FrameData frame;
+    SpotLightData spotLight;
+
+    void Create()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        offsets[FRAME_DATA_BINDING] = 0;
+        offsets[SPOT_LIGHT_BINDING] = Align(offsets[FRAME_DATA_BINDING] + sizeof(FrameData), alignment);
+        segmentSize = Align(offsets[SPOT_LIGHT_BINDING] + sizeof(SpotLightData), alignment);
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, segmentSize * RING_SIZE, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // Copies the blocks into the next ring segment and binds it. Call
+    // once per frame before the first draw that reads the blocks.
+    void Upload()
+    {
+        // Everything submitted since the last upload reads the previous segment.
+        if (fences[current]) glDeleteSync(fences[current]);
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        current = (current + 1) % RING_SIZE;
+        if (fences[current]) {
+            while (glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+            glDeleteSync(fences[current]);
+            fences[current] = 0;
+        }
+
+        GLintptr base = static_cast<GLintptr>(segmentSize) * current;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        char* data = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, base, segmentSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+        if (data) {
+            std::memcpy(data + offsets[FRAME_DATA_BINDING], &frame, sizeof(FrameData));
+            std::memcpy(data + offsets[SPOT_LIGHT_BINDING], &spotLight, sizeof(SpotLightData));
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer, base + offsets[FRAME_DATA_BINDING], sizeof(FrameData));
+        glBindBufferRange(GL_UNIFORM_BUFFER, SPOT_LIGHT_BINDING, buffer, base + offsets[SPOT_LIGHT_BINDING], sizeof(SpotLightData));
+    }
+
+private:
+    unsigned int buffer = 0;
+    size_t offsets[UNIFORM_BLOCK_COUNT] = {};
+    size_t segmentSize = 0;
+    int current = 0;
+    GLsync fences[RING_SIZE] = {};
+
+    static size_t Align(size_t value, GLint alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+};
+#endif
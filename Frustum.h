@@ -0,0 +1,135 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+
+#include <cstdint>
+#include <cmath>
+
+// The six clip planes of a view-projection matrix, pointing inwards. A box is
+// culled when it lies completely behind one plane; boxes near a frustum corner
+// may pass although they are outside, which only costs a wasted draw.
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rowX(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 rowY(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 rowZ(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 rowW(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        planes[0] = rowW + rowX;
+        planes[1] = rowW - rowX;
+        planes[2] = rowW + rowY;
+        planes[3] = rowW - rowY;
+        planes[4] = rowW + rowZ;
+        planes[5] = rowW - rowZ;
+    }
+
+    bool Intersects(const AABB& box) const
+    {
+        glm::vec3 center = Center(box);
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 normal(plane);
+            if (glm::dot(normal, center) + glm::dot(glm::abs(normal), extent) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // Writes the indices of the boxes that intersect the frustum into visible
+    // (room for boxes.Size() entries) and returns how many were written.
+    size_t Cull(const AABBSoA& boxes, uint32_t* visible) const
+    {
+        return SelectKernel()(*this, boxes, boxes.Size(), visible);
+    }
+
+    typedef size_t(*CullKernel)(const Frustum&, const AABBSoA&, size_t, uint32_t*);
+
+    static size_t CullScalar(const Frustum& f, const AABBSoA& s, size_t count, uint32_t* visible)
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            visible[n] = static_cast<uint32_t>(i);
+            n += f.Intersects(s.Get(i)) ? 1 : 0;
+        }
+        return n;
+    }
+
+#ifdef AABB_SOA_X86
+    // Each plane is tested against box center and half extent:
+    // dot(n, c) + dot(|n|, e) + w < 0 means the box is entirely outside.
+    static size_t CullSSE(const Frustum& f, const AABBSoA& s, size_t count, uint32_t* visible)
+    {
+        const __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+        size_t n = 0;
+        for (size_t i = 0; i < count; i += 4) {
+            __m128 minX = _mm_loadu_ps(&s.minX[i]), maxX = _mm_loadu_ps(&s.maxX[i]);
+            __m128 minY = _mm_loadu_ps(&s.minY[i]), maxY = _mm_loadu_ps(&s.maxY[i]);
+            __m128 minZ = _mm_loadu_ps(&s.minZ[i]), maxZ = _mm_loadu_ps(&s.maxZ[i]);
+            __m128 centerX = _mm_mul_ps(_mm_add_ps(minX, maxX), half), extentX = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+            __m128 centerY = _mm_mul_ps(_mm_add_ps(minY, maxY), half), extentY = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+            __m128 centerZ = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half), extentZ = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+            __m128 outside = zero;
+            for (const glm::vec4& plane : f.planes) {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)), _mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::fabs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::fabs(plane.y)))),
+                    _mm_mul_ps(extentZ, _mm_set1_ps(std::fabs(plane.z))));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+            }
+            unsigned mask = ~static_cast<unsigned>(_mm_movemask_ps(outside)) & AABBSoA::TailMask(count - i, 4);
+            n += AABBSoA::WriteHits(mask, i, visible + n);
+        }
+        return n;
+    }
+
+    AABB_SOA_TARGET_AVX
+    static size_t CullAVX(const Frustum& f, const AABBSoA& s, size_t count, uint32_t* visible)
+    {
+        const __m256 half = _mm256_set1_ps(0.5f), zero = _mm256_setzero_ps();
+        size_t n = 0;
+        for (size_t i = 0; i < count; i += 8) {
+            __m256 minX = _mm256_loadu_ps(&s.minX[i]), maxX = _mm256_loadu_ps(&s.maxX[i]);
+            __m256 minY = _mm256_loadu_ps(&s.minY[i]), maxY = _mm256_loadu_ps(&s.maxY[i]);
+            __m256 minZ = _mm256_loadu_ps(&s.minZ[i]), maxZ = _mm256_loadu_ps(&s.maxZ[i]);
+            __m256 centerX = _mm256_mul_ps(_mm256_add_ps(minX, maxX), half), extentX = _mm256_mul_ps(_mm256_sub_ps(maxX, minX), half);
+            __m256 centerY = _mm256_mul_ps(_mm256_add_ps(minY, maxY), half), extentY = _mm256_mul_ps(_mm256_sub_ps(maxY, minY), half);
+            __m256 centerZ = _mm256_mul_ps(_mm256_add_ps(minZ, maxZ), half), extentZ = _mm256_mul_ps(_mm256_sub_ps(maxZ, minZ), half);
+            __m256 outside = zero;
+            for (const glm::vec4& plane : f.planes) {
+                __m256 distance = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(plane.x)), _mm256_mul_ps(centerY, _mm256_set1_ps(plane.y))),
+                    _mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+                __m256 radius = _mm256_add_ps(
+                    _mm256_add_ps(_mm256_mul_ps(extentX, _mm256_set1_ps(std::fabs(plane.x))), _mm256_mul_ps(extentY, _mm256_set1_ps(std::fabs(plane.y)))),
+                    _mm256_mul_ps(extentZ, _mm256_set1_ps(std::fabs(plane.z))));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+            }
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_ps(outside)) & AABBSoA::TailMask(count - i, 8);
+            n += AABBSoA::WriteHits(mask, i, visible + n);
+        }
+        return n;
+    }
+#endif
+
+    static CullKernel SelectKernel()
+    {
+#ifdef AABB_SOA_X86
+        static const CullKernel kernel = AABBSoA::CpuHasAVX() ? &CullAVX : &CullSSE;
+        return kernel;
+#else
+        return &CullScalar;
+#endif
+    }
+};
+#endif
@@ -0,0 +1,132 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include "Simulation.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Binary layout, little endian:
+//   header: "LGIR", uint32 version, float tick rate, uint32 random seed
+//   one record per simulation tick: uint16 key bits, float mouse dx, float mouse dy, float seconds since start
+// Bit 15 of the key bits marks a tick that started with a menu restart.
+struct InputRecord {
+    uint16_t keys;
+    float mouseDeltaX;
+    float mouseDeltaY;
+    float time;
+};
+
+static const char INPUT_RECORDING_MAGIC[4] = { 'L', 'G', 'I', 'R' };
+static const uint32_t INPUT_RECORDING_VERSION = 1;
+static const uint16_t INPUT_RECORD_RESTART = 1 << 15;
+
+class InputRecorder
+{
+public:
+    bool Open(const std::string& path, float tickRate, uint32_t seed)
+    {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(INPUT_RECORDING_MAGIC, sizeof(INPUT_RECORDING_MAGIC));
+        Write(INPUT_RECORDING_VERSION);
+        Write(tickRate);
+        Write(seed);
+        startTime = -1.0;
+        return true;
+    }
+
+    bool IsOpen() const { return file.is_open(); }
+
+    void Record(const InputState& input, const InputState& previous, bool restart, double tickTime)
+    {
+        if (startTime < 0.0)
+            startTime = tickTime;
+        uint16_t keys = restart ? INPUT_RECORD_RESTART : 0;
+        for (int i = 0; i < INPUT_KEY_COUNT; i++)
+            if (input.keys[i]) keys |= 1 << i;
+        Write(keys);
+        Write(static_cast<float>(input.mouseX - previous.mouseX));
+        Write(static_cast<float>(input.mouseY - previous.mouseY));
+        Write(static_cast<float>(tickTime - startTime));
+    }
+
+    void Close()
+    {
+        if (file.is_open())
+            file.close();
+    }
+
+private:
+    std::ofstream file;
+    double startTime = -1.0;
+
+    template <typename T>
+    void Write(const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+};
+
+// Plays a recording back one tick at a time in place of live input.
+class InputReplay
+{
+public:
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[4];
+        uint32_t version = 0;
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, INPUT_RECORDING_MAGIC, sizeof(magic)) != 0 ||
+            !Read(file, version) || version != INPUT_RECORDING_VERSION || !Read(file, tickRate) || !Read(file, seed))
+            return false;
+
+        InputRecord record;
+        records.clear();
+        while (Read(file, record.keys) && Read(file, record.mouseDeltaX) && Read(file, record.mouseDeltaY) && Read(file, record.time))
+            records.push_back(record);
+        next = 0;
+        state = InputState();
+        return true;
+    }
+
+    bool IsLoaded() const { return tickRate > 0.0f; }
+
+    // Advances to the next recorded tick; returns false once the recording is exhausted.
+    bool Next(InputState& input, bool& restart)
+    {
+        if (next >= records.size())
+            return false;
+        const InputRecord& record = records[next++];
+        for (int i = 0; i < INPUT_KEY_COUNT; i++)
+            state.keys[i] = (record.keys & (1 << i)) != 0;
+        state.mouseX += record.mouseDeltaX;
+        state.mouseY += record.mouseDeltaY;
+        restart = (record.keys & INPUT_RECORD_RESTART) != 0;
+        input = state;
+        return true;
+    }
+
+    float GetTickRate() const { return tickRate; }
+    uint32_t GetSeed() const { return seed; }
+    size_t GetTickCount() const { return records.size(); }
+    float GetDuration() const { return records.empty() ? 0.0f : records.back().time; }
+
+private:
+    std::vector<InputRecord> records;
+    size_t next = 0;
+    InputState state;
+    float tickRate = 0.0f;
+    uint32_t seed = 0;
+
+    template <typename T>
+    static bool Read(std::ifstream& file, T& value)
+    {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+};
+#endif
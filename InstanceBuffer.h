@@ -0,0 +1,49 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Per-instance model matrices for glDraw*Instanced. The matrix is fed to the
+// vertex shader as a mat4 attribute in locations INSTANCE_ATTRIBUTE..+3,
+// advancing once per instance instead of once per vertex.
+class InstanceBuffer
+{
+public:
+    static const unsigned int INSTANCE_ATTRIBUTE = 7;
+
+    unsigned int buffer = 0;
+    GLsizei count = 0;
+
+    void Create()
+    {
+        glGenBuffers(1, &buffer);
+    }
+
+    // Replaces the contents; the old storage is orphaned so a draw still
+    // reading it never stalls the upload.
+    void Upload(const std::vector<glm::mat4>& matrices)
+    {
+        count = static_cast<GLsizei>(matrices.size());
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, matrices.size() * sizeof(glm::mat4), matrices.empty() ? NULL : &matrices[0], GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Points the instance attributes of vao at this buffer.
+    void AttachTo(unsigned int vao) const
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (unsigned int column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(INSTANCE_ATTRIBUTE + column);
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(INSTANCE_ATTRIBUTE + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+#endif
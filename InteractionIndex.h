@@ -0,0 +1,90 @@
+#ifndef INTERACTION_INDEX_H
+#define INTERACTION_INDEX_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "SpatialGrid.h"
+
+#include <vector>
+#include <cmath>
+
+enum InteractionKind {
+    INTERACTION_BONFIRE,
+    INTERACTION_BATTERY
+};
+
+// A point the player can use with E from within radius, e.g. a bonfire or a battery.
+struct InteractionTrigger {
+    glm::vec3 position;
+    float radius;
+    InteractionKind kind;
+    int id;         // index into the owning array (pointLights, batteries)
+    bool enabled;
+};
+
+// Trigger volumes in a spatial grid, so a query only looks at the triggers
+// around the player no matter how many the level has.
+class InteractionIndex
+{
+public:
+    int Add(const glm::vec3& position, float radius, InteractionKind kind, int id)
+    {
+        triggers.push_back({ position, radius, kind, id, true });
+        return static_cast<int>(triggers.size()) - 1;
+    }
+
+    void Build()
+    {
+        std::vector<AABB> volumes;
+        volumes.reserve(triggers.size());
+        float maxRadius = 0.0f;
+        for (const auto& trigger : triggers) {
+            volumes.push_back({ trigger.position - glm::vec3(trigger.radius), trigger.position + glm::vec3(trigger.radius) });
+            maxRadius = std::max(maxRadius, trigger.radius);
+        }
+        grid.Build(volumes, std::max(maxRadius * 2.0f, 1.0f));
+    }
+
+    // Enabled triggers within reach of eye that lie inside the cone of maxAngle
+    // degrees around front (normalized), in registration order.
+    void Query(const glm::vec3& eye, const glm::vec3& front, float maxAngle, std::vector<int>& result) const
+    {
+        float cosMaxAngle = std::cos(glm::radians(maxAngle));
+        float cosSquared = cosMaxAngle * cosMaxAngle;
+
+        std::vector<int> candidates;
+        grid.Query({ eye, eye }, candidates);
+        for (int index : candidates) {
+            const InteractionTrigger& trigger = triggers[index];
+            if (!trigger.enabled)
+                continue;
+            glm::vec3 toTrigger = trigger.position - eye;
+            float distanceSquared = glm::dot(toTrigger, toTrigger);
+            if (distanceSquared > trigger.radius * trigger.radius)
+                continue;
+            // dot(front, dir) >= cos(angle) without normalizing dir.
+            float along = glm::dot(front, toTrigger);
+            if (along < 0.0f || along * along < cosSquared * distanceSquared)
+                continue;
+            result.push_back(index);
+        }
+    }
+
+    const InteractionTrigger& Get(int index) const { return triggers[index]; }
+
+    void SetEnabled(int index, bool enabled)
+    {
+        triggers[index].enabled = enabled;
+    }
+
+    void EnableAll()
+    {
+        for (auto& trigger : triggers)
+            trigger.enabled = true;
+    }
+
+private:
+    std::vector<InteractionTrigger> triggers;
+    SpatialGrid grid;
+};
+#endif
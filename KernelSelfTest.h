@@ -0,0 +1,156 @@
+#ifndef KERNEL_SELF_TEST_H
+#define KERNEL_SELF_TEST_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+#include "Frustum.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+// Checks that every SIMD kernel this CPU can run returns exactly what the
+// scalar kernel returns, on random boxes. Coordinates are whole numbers so
+// touching faces, which count as overlapping, come up often.
+// Run with: LabirintGL --self-test
+class KernelSelfTest
+{
+public:
+    static const int QUERIES_PER_SIZE = 200;
+    static const int FRUSTA_PER_SIZE = 50;
+
+    // True when every kernel agreed.
+    static bool Run()
+    {
+        std::mt19937 gen(4321);
+        int failures = TestOverlaps(gen);
+        failures += TestCull(gen);
+        std::printf("Kernel self-test: %s\n", failures == 0 ? "passed" : "FAILED");
+        return failures == 0;
+    }
+
+private:
+    // Box counts around the 4- and 8-lane block sizes, so ranges end inside the
+    // padding as well as on block boundaries.
+    static std::vector<size_t> Sizes()
+    {
+        return { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100, 257 };
+    }
+
+    static std::vector<AABB> RandomBoxes(std::mt19937& gen, size_t count)
+    {
+        std::uniform_int_distribution<int> coord(-20, 20), size(0, 6);
+        std::vector<AABB> boxes;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 min(coord(gen), coord(gen), coord(gen));
+            boxes.push_back({ min, min + glm::vec3(size(gen), size(gen), size(gen)) });
+        }
+        return boxes;
+    }
+
+    struct OverlapKernelEntry {
+        const char* name;
+        AABBSoA::OverlapKernel kernel;
+    };
+
+    static std::vector<OverlapKernelEntry> OverlapKernels()
+    {
+        std::vector<OverlapKernelEntry> kernels = { { "scalar", &AABBSoA::OverlapsScalar } };
+#ifdef AABB_SOA_X86
+        kernels.push_back({ "sse", &AABBSoA::OverlapsSSE });
+        if (AABBSoA::CpuHasAVX())
+            kernels.push_back({ "avx", &AABBSoA::OverlapsAVX });
+#endif
+        return kernels;
+    }
+
+    // Random sub-ranges with unaligned starts, compared against the scalar kernel.
+    static int TestOverlaps(std::mt19937& gen)
+    {
+        std::vector<OverlapKernelEntry> kernels = OverlapKernels();
+        int failures = 0;
+        for (size_t size : Sizes()) {
+            AABBSoA boxes;
+            boxes.Assign(RandomBoxes(gen, size));
+            std::vector<AABB> queries = RandomBoxes(gen, QUERIES_PER_SIZE);
+            std::vector<uint32_t> expected(size + 1), hits(size + 1);
+            for (const AABB& query : queries) {
+                size_t first = std::uniform_int_distribution<size_t>(0, size)(gen);
+                size_t rangeCount = std::uniform_int_distribution<size_t>(0, size - first)(gen);
+                size_t expectedCount = AABBSoA::OverlapsScalar(boxes, query, first, rangeCount, expected.data());
+                for (size_t k = 1; k < kernels.size(); k++) {
+                    size_t count = kernels[k].kernel(boxes, query, first, rangeCount, hits.data());
+                    if (!Same(expected, expectedCount, hits, count)) {
+                        if (failures++ < 10)
+                            std::printf("  overlap %s: %zu boxes, range [%zu, %zu): %zu hits, scalar %zu\n",
+                                kernels[k].name, size, first, first + rangeCount, count, expectedCount);
+                    }
+                }
+            }
+        }
+        std::printf("AABBSoA overlap kernels (%zu): %d mismatches\n", kernels.size(), failures);
+        return failures;
+    }
+
+    struct CullKernelEntry {
+        const char* name;
+        Frustum::CullKernel kernel;
+    };
+
+    static std::vector<CullKernelEntry> CullKernels()
+    {
+        std::vector<CullKernelEntry> kernels = { { "scalar", &Frustum::CullScalar } };
+#ifdef AABB_SOA_X86
+        kernels.push_back({ "sse", &Frustum::CullSSE });
+        if (AABBSoA::CpuHasAVX())
+            kernels.push_back({ "avx", &Frustum::CullAVX });
+#endif
+        return kernels;
+    }
+
+    // Random cameras in and around the boxes, compared against the scalar kernel.
+    static int TestCull(std::mt19937& gen)
+    {
+        std::vector<CullKernelEntry> kernels = CullKernels();
+        std::uniform_real_distribution<float> position(-30.0f, 30.0f), fov(30.0f, 100.0f), aspect(0.5f, 2.5f), far(5.0f, 60.0f);
+        int failures = 0;
+        for (size_t size : Sizes()) {
+            AABBSoA boxes;
+            boxes.Assign(RandomBoxes(gen, size));
+            std::vector<uint32_t> expected(size + 1), visible(size + 1);
+            for (int i = 0; i < FRUSTA_PER_SIZE; i++) {
+                glm::vec3 eye(position(gen), position(gen), position(gen));
+                glm::vec3 target(position(gen), position(gen), position(gen));
+                if (glm::length(target - eye) < 1.0f)
+                    target = eye + glm::vec3(0.0f, 0.0f, -1.0f);
+                glm::mat4 projection = glm::perspective(glm::radians(fov(gen)), aspect(gen), 0.1f, far(gen));
+                Frustum frustum(projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+                size_t expectedCount = Frustum::CullScalar(frustum, boxes, size, expected.data());
+                for (size_t k = 1; k < kernels.size(); k++) {
+                    size_t count = kernels[k].kernel(frustum, boxes, size, visible.data());
+                    if (!Same(expected, expectedCount, visible, count)) {
+                        if (failures++ < 10)
+                            std::printf("  cull %s: %zu boxes: %zu visible, scalar %zu\n", kernels[k].name, size, count, expectedCount);
+                    }
+                }
+            }
+        }
+        std::printf("Frustum cull kernels (%zu): %d mismatches\n", kernels.size(), failures);
+        return failures;
+    }
+
+    static bool Same(const std::vector<uint32_t>& a, size_t aCount, const std::vector<uint32_t>& b, size_t bCount)
+    {
+        if (aCount != bCount)
+            return false;
+        for (size_t i = 0; i < aCount; i++)
+            if (a[i] != b[i])
+                return false;
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,284 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+// A point light as the lighting shader sees it. Attenuation is
+// 1 / (constant + linear * d + quadratic * d^2).
+struct ClusterLight {
+    glm::vec3 position;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// Texture units the cluster buffers are bound to; units 0-3 hold the material
+// maps and the shadow map.
+enum LightClusterTextureUnit {
+    LIGHT_DATA_UNIT = 4,
+    LIGHT_GRID_UNIT = 5,
+    LIGHT_INDEX_UNIT = 6
+};
+
+// Clustered forward shading. The view frustum is split into TILES_X x TILES_Y
+// screen tiles and SLICES exponentially spaced depth slices. Each frame the
+// lights are binned on the CPU into every cluster their range sphere touches,
+// and a fragment only evaluates the lights of its own cluster. The results
+// reach the shader through texture buffers:
+//   lightData     3 RGBA32F texels per light: position + quadratic,
+//                 diffuse + constant, specular + linear
+//   lightGrid     RG32UI per cluster: first entry in lightIndices, light count
+//   lightIndices  R16UI light numbers
+class LightClusters
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static constexpr size_t MAX_LIGHTS = 65536;    // light numbers are 16-bit
+
+    // Light the shader may drop: contributions below this fraction of full
+    // brightness are lost in 8-bit output.
+    static constexpr float CUTOFF = 1.0f / 256.0f;
+    // Depth where the exponential slicing starts; everything nearer is slice 0.
+    static constexpr float SLICE_NEAR = 1.0f;
+
+    void Create()
+    {
+        for (int i = 0; i < BUFFER_COUNT; i++) {
+            glGenBuffers(1, &buffers[i]);
+            glGenTextures(1, &textures[i]);
+        }
+    }
+
+    // Distance beyond which light contributes less than CUTOFF; 0 for a light
+    // that is switched off.
+    static float Radius(const ClusterLight& light)
+    {
+        glm::vec3 brightest = glm::max(light.diffuse, light.specular);
+        float intensity = std::max(brightest.x, std::max(brightest.y, brightest.z));
+        if (intensity <= 0.0f)
+            return 0.0f;
+        // Solve constant + linear * d + quadratic * d^2 = intensity / CUTOFF.
+        float target = intensity / CUTOFF - light.constant;
+        if (target <= 0.0f)
+            return 0.0f;
+        if (light.quadratic > 0.0f)
+            return (-light.linear + std::sqrt(light.linear * light.linear + 4.0f * light.quadratic * target)) / (2.0f * light.quadratic);
+        if (light.linear > 0.0f)
+            return target / light.linear;
+        return FLT_MAX;
+    }
+
+    // Bins lights for a camera with a glm::perspective projection rendering
+    // into a viewport of the given size, and uploads the buffers.
+    void Build(const std::vector<ClusterLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+        float farPlane, float viewportWidth, float viewportHeight)
+    {
+        tileSize = glm::vec2(viewportWidth / TILES_X, viewportHeight / TILES_Y);
+        sliceScale = SLICES / std::log(farPlane / SLICE_NEAR);
+        if (projection[0][0] != builtFor.x || projection[1][1] != builtFor.y || farPlane != builtFor.z)
+            BuildClusterBounds(projection, farPlane);
+
+        size_t lightCount = std::min(lights.size(), MAX_LIGHTS);
+        lightData.resize(lightCount * 3);
+        spheres.clear();
+        for (size_t i = 0; i < lightCount; i++) {
+            const ClusterLight& light = lights[i];
+            lightData[i * 3] = glm::vec4(light.position, light.quadratic);
+            lightData[i * 3 + 1] = glm::vec4(light.diffuse, light.constant);
+            lightData[i * 3 + 2] = glm::vec4(light.specular, light.linear);
+            float radius = Radius(light);
+            if (radius > 0.0f)
+                spheres.push_back({ glm::vec3(view * glm::vec4(light.position, 1.0f)), radius, static_cast<uint16_t>(i) });
+        }
+
+        // Two passes over the same overlap tests: count per cluster, then fill.
+        grid.assign(CLUSTER_COUNT, glm::uvec2(0));
+        ForEachOverlap(farPlane, [&](int cluster, uint16_t) { grid[cluster].y++; });
+        unsigned int total = 0;
+        for (glm::uvec2& cell : grid) {
+            cell.x = total;
+            total += cell.y;
+            cell.y = 0;
+        }
+        indices.resize(total);
+        ForEachOverlap(farPlane, [&](int cluster, uint16_t light) { indices[grid[cluster].x + grid[cluster].y++] = light; });
+
+        assigned = total;
+        maxPerCluster = 0;
+        for (const glm::uvec2& cell : grid)
+            maxPerCluster = std::max<size_t>(maxPerCluster, cell.y);
+
+        Upload(LIGHT_DATA, GL_RGBA32F, lightData.data(), lightData.size() * sizeof(glm::vec4));
+        Upload(LIGHT_GRID, GL_RG32UI, grid.data(), grid.size() * sizeof(glm::uvec2));
+        Upload(LIGHT_INDICES, GL_R16UI, indices.data(), indices.size() * sizeof(uint16_t));
+    }
+
+    // Handles of the cluster uniforms in one program.
+    struct Uniforms {
+        Shader::Uniform count;
+        Shader::Uniform tileSize;
+        Shader::Uniform sliceNear;
+        Shader::Uniform sliceScale;
+    };
+
+    // Resolve once per program, when it is created.
+    static Uniforms Resolve(const Shader& shader)
+    {
+        Uniforms uniforms;
+        uniforms.count = shader.getUniform("clusterCount");
+        uniforms.tileSize = shader.getUniform("clusterTileSize");
+        uniforms.sliceNear = shader.getUniform("clusterSliceNear");
+        uniforms.sliceScale = shader.getUniform("clusterSliceScale");
+        return uniforms;
+    }
+
+    // Binds the buffers and sets the cluster uniforms; shader must be in use.
+    void Bind(const Shader& shader, const Uniforms& uniforms) const
+    {
+        const GLenum units[BUFFER_COUNT] = { LIGHT_DATA_UNIT, LIGHT_GRID_UNIT, LIGHT_INDEX_UNIT };
+        for (int i = 0; i < BUFFER_COUNT; i++) {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glUniform3i(uniforms.count.location, TILES_X, TILES_Y, SLICES);
+        shader.setVec2(uniforms.tileSize, tileSize);
+        shader.setFloat(uniforms.sliceNear, SLICE_NEAR);
+        shader.setFloat(uniforms.sliceScale, sliceScale);
+    }
+
+    // Light entries over all clusters, and the most any one cluster holds.
+    size_t GetAssignedCount() const { return assigned; }
+    size_t GetMaxLightsPerCluster() const { return maxPerCluster; }
+
+    // Lights that reach anything at all; 0 when every light is switched off.
+    size_t GetActiveLightCount() const { return spheres.size(); }
+
+private:
+    enum Buffer {
+        LIGHT_DATA,
+        LIGHT_GRID,
+        LIGHT_INDICES,
+        BUFFER_COUNT
+    };
+
+    struct Sphere {
+        glm::vec3 center;   // view space
+        float radius;
+        uint16_t light;
+    };
+
+    unsigned int buffers[BUFFER_COUNT] = {};
+    unsigned int textures[BUFFER_COUNT] = {};
+
+    glm::vec2 tileSize = glm::vec2(1.0f);
+    float sliceScale = 1.0f;
+    glm::vec3 builtFor = glm::vec3(0.0f);   // projection[0][0], projection[1][1], far plane
+    std::vector<glm::vec3> clusterMin, clusterMax;  // view space, tile-major within a slice
+    std::vector<float> sliceDepth;                  // SLICES + 1 boundaries, positive distances
+
+    std::vector<glm::vec4> lightData;
+    std::vector<Sphere> spheres;
+    std::vector<glm::uvec2> grid;
+    std::vector<uint16_t> indices;
+    size_t assigned = 0, maxPerCluster = 0;
+
+    int SliceOf(float depth) const
+    {
+        if (depth <= SLICE_NEAR)
+            return 0;
+        return std::min(SLICES - 1, static_cast<int>(std::log(depth / SLICE_NEAR) * sliceScale));
+    }
+
+    // View-space boxes around every cluster's frustum piece. A symmetric
+    // projection puts NDC (x, y) at depth d at (x * d / P00, y * d / P11).
+    void BuildClusterBounds(const glm::mat4& projection, float farPlane)
+    {
+        builtFor = glm::vec3(projection[0][0], projection[1][1], farPlane);
+        sliceDepth.resize(SLICES + 1);
+        sliceDepth[0] = 0.0f;
+        for (int k = 1; k <= SLICES; k++)
+            sliceDepth[k] = SLICE_NEAR * std::pow(farPlane / SLICE_NEAR, static_cast<float>(k) / SLICES);
+
+        clusterMin.resize(CLUSTER_COUNT);
+        clusterMax.resize(CLUSTER_COUNT);
+        for (int k = 0; k < SLICES; k++)
+            for (int y = 0; y < TILES_Y; y++)
+                for (int x = 0; x < TILES_X; x++) {
+                    glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+                    for (int corner = 0; corner < 8; corner++) {
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / TILES_X;
+                        float ndcY = -1.0f + 2.0f * (y + ((corner >> 1) & 1)) / TILES_Y;
+                        float depth = sliceDepth[k + (corner >> 2)];
+                        glm::vec3 point(ndcX * depth / projection[0][0], ndcY * depth / projection[1][1], -depth);
+                        lo = glm::min(lo, point);
+                        hi = glm::max(hi, point);
+                    }
+                    int cluster = x + TILES_X * (y + TILES_Y * k);
+                    clusterMin[cluster] = lo;
+                    clusterMax[cluster] = hi;
+                }
+    }
+
+    template <typename Visit>
+    void ForEachOverlap(float farPlane, Visit visit) const
+    {
+        for (const Sphere& sphere : spheres) {
+            float nearest = -sphere.center.z - sphere.radius;
+            float farthest = -sphere.center.z + sphere.radius;
+            if (farthest < 0.0f || nearest > farPlane)
+                continue;
+            int firstSlice = SliceOf(std::max(nearest, 0.0f));
+            int lastSlice = SliceOf(std::min(farthest, farPlane));
+            float radiusSquared = sphere.radius * sphere.radius;
+            for (int k = firstSlice; k <= lastSlice; k++) {
+                // A cluster's x extent depends only on its column and its y
+                // extent only on its row, so narrow to a rectangle of tiles first.
+                int slice = TILES_X * TILES_Y * k;
+                int x0 = 0, x1 = TILES_X - 1, y0 = 0, y1 = TILES_Y - 1;
+                while (x0 <= x1 && clusterMax[slice + x0].x < sphere.center.x - sphere.radius) x0++;
+                while (x1 >= x0 && clusterMin[slice + x1].x > sphere.center.x + sphere.radius) x1--;
+                while (y0 <= y1 && clusterMax[slice + TILES_X * y0].y < sphere.center.y - sphere.radius) y0++;
+                while (y1 >= y0 && clusterMin[slice + TILES_X * y1].y > sphere.center.y + sphere.radius) y1--;
+                for (int y = y0; y <= y1; y++)
+                    for (int x = x0; x <= x1; x++) {
+                        int cluster = slice + x + TILES_X * y;
+                        glm::vec3 closest = glm::clamp(sphere.center, clusterMin[cluster], clusterMax[cluster]);
+                        glm::vec3 offset = closest - sphere.center;
+                        if (glm::dot(offset, offset) <= radiusSquared)
+                            visit(cluster, sphere.light);
+                    }
+            }
+        }
+    }
+
+    // Replaces a buffer's contents, orphaning the old storage, and points its
+    // buffer texture at it.
+    void Upload(Buffer which, GLenum format, const void* data, size_t bytes)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[which]);
+        // An empty buffer texture is not guaranteed to be valid; keep one element.
+        glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(bytes, 16), NULL, GL_STREAM_DRAW);
+        if (bytes > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+        glBindTexture(GL_TEXTURE_BUFFER, textures[which]);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffers[which]);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+};
+#endif
@@ -0,0 +1,211 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "mesh.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+// Optimized meshes of one model file, so the import and the optimization
+// pipeline only run when the cache is missing or the source files changed.
+// Binary layout, little endian:
+//   header: "LGMC", uint32 version, uint32 sizeof(Vertex), MeshCacheKey, uint32 mesh count
+//   per mesh: uint32 vertex count, uint32 index count, uint32 texture count,
+//             raw Vertex structs, uint32 indices,
+//             per texture: uint32 length + type name, uint32 length + path relative to the model
+struct CachedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Texture> textures;      // type and path only; ids are filled in on load
+};
+
+// What a cache was built from: modification time and FNV-1a content hash of
+// the OBJ and of the material libraries its mtllib lines name (times are the
+// newest, hashes run over all libraries in order). Textures are not part of
+// the key; they are read from their own files on every launch.
+struct MeshCacheKey {
+    uint64_t sourceTime = 0;
+    uint64_t sourceHash = 0;
+    uint64_t materialTime = 0;
+    uint64_t materialHash = 0;
+
+    bool operator==(const MeshCacheKey& other) const
+    {
+        return sourceTime == other.sourceTime && sourceHash == other.sourceHash &&
+            materialTime == other.materialTime && materialHash == other.materialHash;
+    }
+};
+
+static const char MESH_CACHE_MAGIC[4] = { 'L', 'G', 'M', 'C' };
+static const uint32_t MESH_CACHE_VERSION = 2;
+
+class MeshCache
+{
+public:
+    // Keys the model file at path; false if it cannot be read. Material
+    // libraries are looked up next to it, and a missing one hashes as empty.
+    static bool MakeKey(const std::string& path, MeshCacheKey& key)
+    {
+        std::string content;
+        if (!ReadFile(path, content))
+            return false;
+        key = MeshCacheKey();
+        key.sourceTime = ModifiedTime(path);
+        key.sourceHash = Hash(content, FNV_OFFSET);
+        key.materialHash = FNV_OFFSET;
+
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        for (size_t start = 0; start < content.size();) {
+            size_t end = std::min(content.find('\n', start), content.size());
+            if (content.compare(start, 7, "mtllib ") == 0) {
+                size_t first = content.find_first_not_of(" \t", start + 7);
+                size_t last = content.find_last_not_of(" \t\r", end - 1);
+                if (first != std::string::npos && last != std::string::npos && first <= last && last < end) {
+                    std::string library = directory + content.substr(first, last - first + 1);
+                    std::string material;
+                    ReadFile(library, material);
+                    key.materialTime = std::max(key.materialTime, ModifiedTime(library));
+                    key.materialHash = Hash(material, key.materialHash);
+                }
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    static bool Load(const std::string& path, const MeshCacheKey& key, std::vector<CachedMesh>& meshes)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[4];
+        uint32_t version = 0, vertexSize = 0, meshCount = 0;
+        MeshCacheKey cachedKey;
+        if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, MESH_CACHE_MAGIC, sizeof(magic)) != 0 ||
+            !Read(file, version) || version != MESH_CACHE_VERSION || !Read(file, vertexSize) || vertexSize != sizeof(Vertex) ||
+            !Read(file, cachedKey) || !(cachedKey == key) || !Read(file, meshCount))
+            return false;
+
+        meshes.assign(meshCount, CachedMesh());
+        for (CachedMesh& mesh : meshes) {
+            uint32_t vertexCount = 0, indexCount = 0, textureCount = 0;
+            if (!Read(file, vertexCount) || !Read(file, indexCount) || !Read(file, textureCount))
+                return false;
+            mesh.vertices.resize(vertexCount);
+            mesh.indices.resize(indexCount);
+            if (!ReadArray(file, mesh.vertices) || !ReadArray(file, mesh.indices))
+                return false;
+            mesh.textures.resize(textureCount);
+            for (Texture& texture : mesh.textures) {
+                texture.id = 0;
+                if (!ReadString(file, texture.type) || !ReadString(file, texture.path))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static bool Save(const std::string& path, const MeshCacheKey& key, const std::vector<Mesh>& meshes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        Write(file, MESH_CACHE_VERSION);
+        Write(file, static_cast<uint32_t>(sizeof(Vertex)));
+        Write(file, key);
+        Write(file, static_cast<uint32_t>(meshes.size()));
+        for (const Mesh& mesh : meshes) {
+            Write(file, static_cast<uint32_t>(mesh.vertices.size()));
+            Write(file, static_cast<uint32_t>(mesh.indices.size()));
+            Write(file, static_cast<uint32_t>(mesh.textures.size()));
+            WriteArray(file, mesh.vertices);
+            WriteArray(file, mesh.indices);
+            for (const Texture& texture : mesh.textures) {
+                WriteString(file, texture.type);
+                WriteString(file, texture.path);
+            }
+        }
+        return static_cast<bool>(file);
+    }
+
+private:
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+    static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+    static uint64_t Hash(const std::string& data, uint64_t hash)
+    {
+        for (unsigned char byte : data) {
+            hash ^= byte;
+            hash *= FNV_PRIME;
+        }
+        return hash;
+    }
+
+    // Seconds since the epoch, or 0 if the file does not exist.
+    static uint64_t ModifiedTime(const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return static_cast<uint64_t>(info.st_mtime);
+    }
+
+    static bool ReadFile(const std::string& path, std::string& content)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        std::ostringstream stream;
+        stream << file.rdbuf();
+        content = stream.str();
+        return true;
+    }
+
+    template <typename T>
+    static void Write(std::ofstream& file, const T& value)
+    {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    static void WriteArray(std::ofstream& file, const std::vector<T>& values)
+    {
+        if (!values.empty())
+            file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    static void WriteString(std::ofstream& file, const std::string& value)
+    {
+        Write(file, static_cast<uint32_t>(value.size()));
+        file.write(value.data(), value.size());
+    }
+
+    template <typename T>
+    static bool Read(std::ifstream& file, T& value)
+    {
+        return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    template <typename T>
+    static bool ReadArray(std::ifstream& file, std::vector<T>& values)
+    {
+        return values.empty() || static_cast<bool>(file.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)));
+    }
+
+    static bool ReadString(std::ifstream& file, std::string& value)
+    {
+        uint32_t length = 0;
+        if (!Read(file, length))
+            return false;
+        value.resize(length);
+        return length == 0 || static_cast<bool>(file.read(&value[0], length));
+    }
+};
+#endif
@@ -0,0 +1,303 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+// Offline index and vertex reordering for the mesh cache:
+//   WeldVertices          merges bit-identical vertices
+//   OptimizeVertexCache   Forsyth's greedy ordering for the post-transform cache
+//   OptimizeOverdraw      sorts the cache-friendly runs front to back (Sander et al.)
+//   OptimizeVertexFetch   renumbers vertices in first-use order
+// Every step keeps each triangle's winding.
+
+static_assert(std::is_trivially_copyable<Vertex>::value, "Vertex is hashed and cached as raw bytes");
+
+// Post-transform cache efficiency under a FIFO cache of CACHE_SIZE entries.
+// ACMR is misses per triangle (0.5 is the ideal for a regular grid, 3 the
+// worst); ATVR is misses per vertex (1 is the ideal).
+struct VertexCacheStats {
+    static const int CACHE_SIZE = 16;
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+inline VertexCacheStats AnalyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    VertexCacheStats stats;
+    if (indices.empty())
+        return stats;
+    std::vector<unsigned int> loadedAt(vertexCount, 0);   // miss counter after the vertex was loaded, 0 = never
+    std::vector<bool> used(vertexCount, false);
+    unsigned int misses = 0;
+    size_t usedCount = 0;
+    for (unsigned int index : indices) {
+        if (loadedAt[index] == 0 || misses - loadedAt[index] >= static_cast<unsigned int>(VertexCacheStats::CACHE_SIZE)) {
+            misses++;
+            loadedAt[index] = misses;
+        }
+        if (!used[index]) {
+            used[index] = true;
+            usedCount++;
+        }
+    }
+    stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / usedCount;
+    return stats;
+}
+
+struct VertexBytesHash {
+    size_t operator()(const Vertex& vertex) const
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return static_cast<size_t>(hash);
+    }
+};
+
+struct VertexBytesEqual {
+    bool operator()(const Vertex& a, const Vertex& b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+inline void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+    unique.reserve(vertices.size());
+    std::vector<Vertex> welded;
+    std::vector<unsigned int> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        auto inserted = unique.insert({ vertices[i], static_cast<unsigned int>(welded.size()) });
+        if (inserted.second)
+            welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+}
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation". Triangles are emitted
+// greedily by the summed score of their vertices: recently used vertices score
+// high, and vertices with few triangles left get a boost so they are finished
+// off instead of leaving stragglers behind.
+inline void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount)
+{
+    const int CACHE_SIZE = 32;
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int index : indices)
+        offsets[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    std::vector<unsigned int> adjacency(indices.size());
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            adjacency[offsets[v] + remaining[v]++] = static_cast<unsigned int>(t);
+        }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    auto vertexScore = [&](unsigned int v) {
+        if (remaining[v] == 0)
+            return -1.0f;
+        float value = 0.0f;
+        int position = cachePosition[v];
+        if (position >= 0)
+            value = position < 3 ? 0.75f : std::pow(1.0f - (position - 3) / float(CACHE_SIZE - 3), 1.5f);
+        return value + 2.0f / std::sqrt(static_cast<float>(remaining[v]));
+    };
+    for (size_t v = 0; v < vertexCount; v++)
+        score[v] = vertexScore(static_cast<unsigned int>(v));
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> cache, nextCache;
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    size_t cursor = 0;
+    long best = -1;
+
+    while (result.size() < indices.size()) {
+        if (best < 0) {
+            // Nothing in the cache has triangles left; restart from the next unused one.
+            while (emitted[cursor])
+                cursor++;
+            best = static_cast<long>(cursor);
+        }
+        const unsigned int* triangle = &indices[best * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        nextCache.assign(triangle, triangle + 3);
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = triangle[k];
+            unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++)
+                if (list[i] == static_cast<unsigned int>(best)) {
+                    list[i] = list[--remaining[v]];
+                    break;
+                }
+        }
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                nextCache.push_back(v);
+        for (size_t i = CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = -1;
+            score[nextCache[i]] = vertexScore(nextCache[i]);
+        }
+        if (nextCache.size() > static_cast<size_t>(CACHE_SIZE))
+            nextCache.resize(CACHE_SIZE);
+        cache.swap(nextCache);
+
+        for (size_t i = 0; i < cache.size(); i++) {
+            cachePosition[cache[i]] = static_cast<int>(i);
+            score[cache[i]] = vertexScore(cache[i]);
+        }
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            const unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                const unsigned int* candidate = &indices[list[i] * 3];
+                float candidateScore = score[candidate[0]] + score[candidate[1]] + score[candidate[2]];
+                if (candidateScore > bestScore) {
+                    bestScore = candidateScore;
+                    best = static_cast<long>(list[i]);
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+// Splits the cache-ordered triangles into runs wherever the cache starts over
+// (a triangle missing on all three vertices), then draws the runs that face
+// outwards from the mesh centre first. Each run keeps its cache-friendly order,
+// so overdraw drops at a small cost in ACMR.
+inline void OptimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices)
+{
+    const size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<size_t> clusterStarts;
+    std::vector<unsigned int> loadedAt(vertices.size(), 0);
+    unsigned int misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[t * 3 + k];
+            if (loadedAt[v] == 0 || misses - loadedAt[v] >= static_cast<unsigned int>(VertexCacheStats::CACHE_SIZE)) {
+                misses++;
+                loadedAt[v] = misses;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3)
+            clusterStarts.push_back(t);
+    }
+    clusterStarts.push_back(triangleCount);
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    struct Cluster {
+        size_t first, last;
+        float sortKey;
+    };
+    std::vector<Cluster> clusters;
+    std::vector<glm::vec3> centroids, normals;
+    std::vector<float> areas;
+    for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            glm::vec3 a = vertices[indices[t * 3]].Position;
+            glm::vec3 b = vertices[indices[t * 3 + 1]].Position;
+            glm::vec3 d = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 cross = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids.push_back(area > 0.0f ? centroid / area : centroid);
+        float normalLength = glm::length(normal);
+        normals.push_back(normalLength > 0.0f ? normal / normalLength : normal);
+        clusters.push_back({ clusterStarts[c], clusterStarts[c + 1], 0.0f });
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+    for (size_t c = 0; c < clusters.size(); c++)
+        clusters[c].sortKey = glm::dot(centroids[c] - meshCentroid, normals[c]);
+
+    std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+        result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.last * 3);
+    indices.swap(result);
+}
+
+// Vertices end up in the order the index buffer first touches them, and
+// vertices no triangle uses are dropped.
+inline void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    const unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+    for (unsigned int& index : indices) {
+        if (remap[index] == UNUSED) {
+            remap[index] = static_cast<unsigned int>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(ordered);
+}
+
+struct MeshOptimizationReport {
+    size_t triangles = 0;
+    size_t verticesBefore = 0, verticesAfter = 0;
+    VertexCacheStats before, after;
+};
+
+// The whole pipeline, in the order the steps depend on each other.
+inline MeshOptimizationReport OptimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    MeshOptimizationReport report;
+    report.triangles = indices.size() / 3;
+    report.verticesBefore = vertices.size();
+    report.before = AnalyzeVertexCache(indices, vertices.size());
+
+    WeldVertices(vertices, indices);
+    OptimizeVertexCache(indices, vertices.size());
+    OptimizeOverdraw(indices, vertices);
+    OptimizeVertexFetch(vertices, indices);
+
+    report.verticesAfter = vertices.size();
+    report.after = AnalyzeVertexCache(indices, vertices.size());
+    return report;
+}
+#endif
@@ -0,0 +1,142 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+
+// A run of at most MAX_VERTICES vertices and MAX_TRIANGLES triangles taken in
+// index buffer order, with a bounding sphere and a cone around its triangle
+// normals. A meshlet whose cone points away from the viewer holds only back
+// faces and can be skipped.
+struct Meshlet {
+    static const size_t MAX_VERTICES = 64;
+    static const size_t MAX_TRIANGLES = 124;
+
+    unsigned int firstIndex;    // relative to the mesh's first index
+    unsigned int indexCount;
+    glm::vec3 center;
+    float radius;
+    glm::vec3 coneAxis;
+    float coneCutoff;           // sine of the cone's spread; 1 never culls
+
+    // viewer in the same space as the vertices. Back-facing is preserved by
+    // affine transforms, so model space works for any model matrix.
+    bool FacesAway(const glm::vec3& viewer) const
+    {
+        glm::vec3 offset = center - viewer;
+        float distance = glm::length(offset);
+        return distance > radius && glm::dot(offset, coneAxis) >= (coneCutoff * distance + radius);
+    }
+};
+
+// The renderer draws both faces, so a back face only hides behind its own
+// surface where that surface is closed. Meshlets with an edge that has no
+// reversed twin anywhere in the mesh keep coneCutoff = 1. VertexType needs a
+// glm::vec3 Position.
+template <typename VertexType>
+std::vector<Meshlet> BuildMeshlets(const std::vector<VertexType>& vertices, const std::vector<unsigned int>& indices)
+{
+    auto position = [&](size_t i) { return vertices[indices[i]].Position; };
+    struct Edge {
+        glm::vec3 from, to;
+        bool operator==(const Edge& other) const { return std::memcmp(this, &other, sizeof(Edge)) == 0; }
+    };
+    struct EdgeHash {
+        size_t operator()(const Edge& edge) const
+        {
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&edge);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Edge); i++)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return static_cast<size_t>(hash);
+        }
+    };
+    // Keyed by position, not index, so UV seams do not break the surface apart.
+    std::unordered_map<Edge, int, EdgeHash> edges;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        for (int k = 0; k < 3; k++)
+            edges[{ position(i + k), position(i + (k + 1) % 3) }]++;
+    auto twinned = [&](size_t triangle) {
+        for (int k = 0; k < 3; k++) {
+            Edge reversed = { position(triangle + (k + 1) % 3), position(triangle + k) };
+            if (edges.find(reversed) == edges.end())
+                return false;
+        }
+        return true;
+    };
+
+    std::vector<Meshlet> meshlets;
+    std::vector<unsigned int> seenIn(vertices.size(), ~0u);
+    size_t first = 0, vertexCount = 0;
+    auto finish = [&](size_t end) {
+        Meshlet meshlet;
+        meshlet.firstIndex = static_cast<unsigned int>(first);
+        meshlet.indexCount = static_cast<unsigned int>(end - first);
+
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX), normalSum(0.0f);
+        bool closed = true;
+        for (size_t i = first; i < end; i += 3) {
+            glm::vec3 a = position(i), b = position(i + 1), c = position(i + 2);
+            lo = glm::min(lo, glm::min(a, glm::min(b, c)));
+            hi = glm::max(hi, glm::max(a, glm::max(b, c)));
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+                normalSum += normal / length;
+            closed = closed && twinned(i);
+        }
+        meshlet.center = (lo + hi) * 0.5f;
+        meshlet.radius = 0.0f;
+        for (size_t i = first; i < end; i++)
+            meshlet.radius = std::max(meshlet.radius, glm::length(position(i) - meshlet.center));
+
+        float axisLength = glm::length(normalSum);
+        meshlet.coneAxis = axisLength > 0.0f ? normalSum / axisLength : glm::vec3(0.0f, 1.0f, 0.0f);
+        float minDot = 1.0f;
+        for (size_t i = first; i < end; i += 3) {
+            glm::vec3 a = position(i), b = position(i + 1), c = position(i + 2);
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length > 0.0f)
+                minDot = std::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+        }
+        // Normals spread by more than about 84 degrees can never all face away.
+        meshlet.coneCutoff = closed && minDot > 0.1f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+        meshlets.push_back(meshlet);
+        first = end;
+        vertexCount = 0;
+    };
+
+    // Vertices of triangle i not yet in the meshlet being filled.
+    auto newVertices = [&](size_t i) {
+        unsigned int current = static_cast<unsigned int>(meshlets.size());
+        size_t count = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = indices[i + k];
+            bool repeated = (k > 0 && v == indices[i]) || (k > 1 && v == indices[i + 1]);
+            count += seenIn[v] != current && !repeated ? 1 : 0;
+        }
+        return count;
+    };
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        size_t added = newVertices(i);
+        if (vertexCount + added > Meshlet::MAX_VERTICES || (i - first) / 3 + 1 > Meshlet::MAX_TRIANGLES) {
+            finish(i);
+            added = newVertices(i);
+        }
+        for (int k = 0; k < 3; k++)
+            seenIn[indices[i + k]] = static_cast<unsigned int>(meshlets.size());
+        vertexCount += added;
+    }
+    if (first < indices.size() - indices.size() % 3)
+        finish(indices.size() - indices.size() % 3);
+    return meshlets;
+}
+#endif
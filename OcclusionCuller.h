@@ -0,0 +1,388 @@
+#ifndef OCCLUSION_CULLER_H
+#define OCCLUSION_CULLER_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+#include "Frustum.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+
+// Software occlusion culling. The nearest large walls are rasterized on the
+// CPU into a small depth buffer, and boxes hidden behind them are dropped
+// before anything is sent to GL. Depth is stored as 1/w, which interpolates
+// linearly across the screen; bigger means nearer and 0 is empty.
+//
+// Begin picks and projects the occluders on the calling thread, then the
+// workers rasterize one band of rows each while the caller carries on
+// submitting other GL work. Wait blocks until the depth buffer and its
+// per-tile minimum (the hierarchical level) are ready for Filter.
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE = 8;
+    static const int TILES_X = WIDTH / TILE;
+    static const int TILES_Y = HEIGHT / TILE;
+    static const size_t MAX_OCCLUDERS = 1024;
+
+    ~OcclusionCuller()
+    {
+        Stop();
+    }
+
+    // Spawns the workers; with zero threads Begin rasterizes inline.
+    void Start(unsigned threadCount)
+    {
+        threadCount = std::min(threadCount, static_cast<unsigned>(TILES_Y));
+        bandCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; i++)
+            workers.emplace_back(&OcclusionCuller::Work, this, i);
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    // Keeps the near-vertical triangles of at least minArea as occluder
+    // candidates: in the maze these are the walls.
+    void SetOccluders(const std::vector<glm::vec3>& triangles, float minArea)
+    {
+        walls.clear();
+        wallAreas.clear();
+        wallBounds.Clear();
+        for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+            glm::vec3 a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            if (length * 0.5f < minArea || std::fabs(normal.y) > 0.7f * length)
+                continue;
+            walls.push_back(a);
+            walls.push_back(b);
+            walls.push_back(c);
+            wallAreas.push_back(length * 0.5f);
+            wallBounds.Add({ glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) });
+        }
+        candidates.resize(wallBounds.Size());
+    }
+
+    // Starts rendering the occluders seen from eye. Must be followed by Wait.
+    void Begin(const glm::vec3& eye, const glm::mat4& newViewProjection)
+    {
+        viewProjection = newViewProjection;
+        culledCount = 0;
+        SelectOccluders(eye);
+
+        if (workers.empty()) {
+            RasterizeBand(0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            pending = static_cast<unsigned>(workers.size());
+        }
+        wake.notify_all();
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+    }
+
+    // True if box is certainly hidden behind the rasterized occluders.
+    bool IsOccluded(const AABB& box) const
+    {
+        const float NEAR_W = 1e-3f;
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearest = 0.0f;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            if (clip.w < NEAR_W)
+                return false;
+            float inverseW = 1.0f / clip.w;
+            float x = (clip.x * inverseW * 0.5f + 0.5f) * WIDTH;
+            float y = (clip.y * inverseW * 0.5f + 0.5f) * HEIGHT;
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+            nearest = std::max(nearest, inverseW);
+        }
+
+        // One pixel of slack on each side covers partially covered edge pixels.
+        int x0 = std::max(0, static_cast<int>(std::floor(minX)) - 1), x1 = std::min(WIDTH - 1, static_cast<int>(std::floor(maxX)) + 1);
+        int y0 = std::max(0, static_cast<int>(std::floor(minY)) - 1), y1 = std::min(HEIGHT - 1, static_cast<int>(std::floor(maxY)) + 1);
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        // The occluder has to be in front by a small margin, so a wall never hides its own mesh.
+        float threshold = nearest * 1.001f;
+        for (int tileY = y0 / TILE; tileY <= y1 / TILE; tileY++) {
+            for (int tileX = x0 / TILE; tileX <= x1 / TILE; tileX++) {
+                if (tileMin[tileY * TILES_X + tileX] > threshold)
+                    continue;
+                // The tile as a whole does not hide the box; look at the covered pixels.
+                int px0 = std::max(x0, tileX * TILE), px1 = std::min(x1, tileX * TILE + TILE - 1);
+                int py0 = std::max(y0, tileY * TILE), py1 = std::min(y1, tileY * TILE + TILE - 1);
+                for (int y = py0; y <= py1; y++)
+                    for (int x = px0; x <= px1; x++)
+                        if (depth[y * WIDTH + x] <= threshold)
+                            return false;
+            }
+        }
+        return true;
+    }
+
+    // Drops the indices whose boxes are occluded; returns the new count.
+    size_t Filter(const AABBSoA& boxes, uint32_t* indices, size_t count)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            indices[kept] = indices[i];
+            kept += IsOccluded(boxes.Get(indices[i])) ? 0 : 1;
+        }
+        culledCount += count - kept;
+        return kept;
+    }
+
+    // Objects Filter removed since the last Begin.
+    size_t GetCulledCount() const { return culledCount; }
+    size_t GetOccluderCount() const { return screenTriangles.size(); }
+    size_t GetCandidateCount() const { return wallAreas.size(); }
+
+private:
+    // Pixel-space triangle; z holds 1/w at each vertex.
+    struct ScreenTriangle {
+        glm::vec3 v[3];
+        int minY, maxY;
+    };
+
+    std::vector<glm::vec3> walls;
+    std::vector<float> wallAreas;
+    AABBSoA wallBounds;
+    std::vector<uint32_t> candidates;
+    std::vector<std::pair<float, uint32_t>> ranked;
+    std::vector<ScreenTriangle> screenTriangles;
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    std::vector<float> depth = std::vector<float>(WIDTH * HEIGHT, 0.0f);
+    std::vector<float> tileMin = std::vector<float>(TILES_X * TILES_Y, 0.0f);
+    size_t culledCount = 0;
+
+    std::vector<std::thread> workers;
+    unsigned bandCount = 1;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned generation = 0;
+    unsigned pending = 0;
+    bool stopping = false;
+
+    void Work(unsigned band)
+    {
+        unsigned seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            RasterizeBand(band);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0)
+                    done.notify_all();
+            }
+        }
+    }
+
+    // Ranks the walls inside the frustum by area over squared distance, which
+    // tracks their size on screen, and projects the best MAX_OCCLUDERS.
+    void SelectOccluders(const glm::vec3& eye)
+    {
+        size_t count = Frustum(viewProjection).Cull(wallBounds, candidates.data());
+        ranked.clear();
+        for (size_t i = 0; i < count; i++) {
+            AABB box = wallBounds.Get(candidates[i]);
+            glm::vec3 offset = glm::max(glm::max(box.min - eye, eye - box.max), glm::vec3(0.0f));
+            ranked.push_back({ wallAreas[candidates[i]] / std::max(glm::dot(offset, offset), 1.0f), candidates[i] });
+        }
+        if (ranked.size() > MAX_OCCLUDERS) {
+            std::nth_element(ranked.begin(), ranked.begin() + MAX_OCCLUDERS, ranked.end(),
+                [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+            ranked.resize(MAX_OCCLUDERS);
+        }
+
+        screenTriangles.clear();
+        for (const auto& entry : ranked) {
+            glm::vec4 clip[3];
+            for (int k = 0; k < 3; k++)
+                clip[k] = viewProjection * glm::vec4(walls[entry.second * 3 + k], 1.0f);
+            ClipAndProject(clip);
+        }
+    }
+
+    // Clips a triangle to the near side of w = NEAR_W and emits it as one or
+    // two screen triangles.
+    void ClipAndProject(const glm::vec4* clip)
+    {
+        const float NEAR_W = 1e-2f;
+        glm::vec4 polygon[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 3];
+            if (a.w >= NEAR_W)
+                polygon[count++] = a;
+            if ((a.w >= NEAR_W) != (b.w >= NEAR_W))
+                polygon[count++] = a + (b - a) * ((NEAR_W - a.w) / (b.w - a.w));
+        }
+        if (count < 3)
+            return;
+
+        glm::vec3 screen[4];
+        for (int i = 0; i < count; i++) {
+            float inverseW = 1.0f / polygon[i].w;
+            screen[i] = glm::vec3((polygon[i].x * inverseW * 0.5f + 0.5f) * WIDTH,
+                (polygon[i].y * inverseW * 0.5f + 0.5f) * HEIGHT, inverseW);
+        }
+        for (int i = 1; i + 1 < count; i++)
+            AddScreenTriangle(screen[0], screen[i], screen[i + 1]);
+    }
+
+    void AddScreenTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        float minX = std::min(a.x, std::min(b.x, c.x)), maxX = std::max(a.x, std::max(b.x, c.x));
+        float minY = std::min(a.y, std::min(b.y, c.y)), maxY = std::max(a.y, std::max(b.y, c.y));
+        if (maxX < 0.0f || minX >= WIDTH || maxY < 0.0f || minY >= HEIGHT)
+            return;
+        ScreenTriangle triangle;
+        triangle.v[0] = a;
+        triangle.v[1] = b;
+        triangle.v[2] = c;
+        triangle.minY = std::max(0, static_cast<int>(std::floor(minY)));
+        triangle.maxY = std::min(HEIGHT - 1, static_cast<int>(std::floor(maxY)));
+        screenTriangles.push_back(triangle);
+    }
+
+    // Clears, rasterizes and builds the tile minimums for one band of rows.
+    // Bands are whole tile rows, so no two workers touch the same tile.
+    void RasterizeBand(unsigned band)
+    {
+        int firstTile = TILES_Y * band / bandCount, lastTile = TILES_Y * (band + 1) / bandCount;
+        int bandMinY = firstTile * TILE, bandMaxY = lastTile * TILE - 1;
+        std::fill(depth.begin() + bandMinY * WIDTH, depth.begin() + (bandMaxY + 1) * WIDTH, 0.0f);
+
+        for (const ScreenTriangle& triangle : screenTriangles) {
+            int minY = std::max(triangle.minY, bandMinY), maxY = std::min(triangle.maxY, bandMaxY);
+            if (minY <= maxY)
+                RasterizeTriangle(triangle, minY, maxY);
+        }
+
+        for (int tileY = firstTile; tileY < lastTile; tileY++)
+            for (int tileX = 0; tileX < TILES_X; tileX++)
+                tileMin[tileY * TILES_X + tileX] = TileMinimum(tileX, tileY);
+    }
+
+    void RasterizeTriangle(const ScreenTriangle& triangle, int minY, int maxY)
+    {
+        glm::vec3 v0 = triangle.v[0], v1 = triangle.v[1], v2 = triangle.v[2];
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::fabs(area) < 1e-6f)
+            return;
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        // Edge functions e(x, y) = a * x + b * y + c, positive inside; depth
+        // is the plane through the three vertices in the same form.
+        float a0 = v1.y - v2.y, b0 = v2.x - v1.x, c0 = v1.x * v2.y - v1.y * v2.x;
+        float a1 = v2.y - v0.y, b1 = v0.x - v2.x, c1 = v2.x * v0.y - v2.y * v0.x;
+        float a2 = v0.y - v1.y, b2 = v1.x - v0.x, c2 = v0.x * v1.y - v0.y * v1.x;
+        float inverseArea = 1.0f / area;
+        float depthA = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * inverseArea;
+        float depthB = (b0 * v0.z + b1 * v1.z + b2 * v2.z) * inverseArea;
+        float depthC = (c0 * v0.z + c1 * v1.z + c2 * v2.z) * inverseArea;
+
+        float minXf = std::min(v0.x, std::min(v1.x, v2.x)), maxXf = std::max(v0.x, std::max(v1.x, v2.x));
+        int minX = std::max(0, static_cast<int>(std::floor(minXf))) & ~3;
+        int maxX = std::min(WIDTH - 1, static_cast<int>(std::floor(maxXf)));
+
+#ifdef AABB_SOA_X86
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), zero = _mm_setzero_ps();
+        const __m128 a0v = _mm_set1_ps(a0), a1v = _mm_set1_ps(a1), a2v = _mm_set1_ps(a2), depthAv = _mm_set1_ps(depthA);
+        for (int y = minY; y <= maxY; y++) {
+            float centerY = y + 0.5f;
+            __m128 row0 = _mm_set1_ps(b0 * centerY + c0), row1 = _mm_set1_ps(b1 * centerY + c1), row2 = _mm_set1_ps(b2 * centerY + c2);
+            __m128 rowDepth = _mm_set1_ps(depthB * centerY + depthC);
+            float* line = &depth[y * WIDTH];
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0v, centerX), row0), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1v, centerX), row1), zero)),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2v, centerX), row2), zero));
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 value = _mm_add_ps(_mm_mul_ps(depthAv, centerX), rowDepth);
+                __m128 current = _mm_loadu_ps(line + x);
+                __m128 nearer = _mm_max_ps(current, value);
+                _mm_storeu_ps(line + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++) {
+            float centerY = y + 0.5f;
+            float* line = &depth[y * WIDTH];
+            for (int x = minX; x <= maxX; x++) {
+                float centerX = x + 0.5f;
+                if (a0 * centerX + b0 * centerY + c0 < 0.0f || a1 * centerX + b1 * centerY + c1 < 0.0f ||
+                    a2 * centerX + b2 * centerY + c2 < 0.0f)
+                    continue;
+                line[x] = std::max(line[x], depthA * centerX + depthB * centerY + depthC);
+            }
+        }
+#endif
+    }
+
+    float TileMinimum(int tileX, int tileY) const
+    {
+        const float* tile = &depth[tileY * TILE * WIDTH + tileX * TILE];
+#ifdef AABB_SOA_X86
+        __m128 minimum = _mm_loadu_ps(tile);
+        for (int y = 0; y < TILE; y++)
+            for (int x = 0; x < TILE; x += 4)
+                minimum = _mm_min_ps(minimum, _mm_loadu_ps(tile + y * WIDTH + x));
+        minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+        minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtss_f32(minimum);
+#else
+        float minimum = tile[0];
+        for (int y = 0; y < TILE; y++)
+            for (int x = 0; x < TILE; x++)
+                minimum = std::min(minimum, tile[y * WIDTH + x]);
+        return minimum;
+#endif
+    }
+};
+#endif
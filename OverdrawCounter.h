@@ -0,0 +1,78 @@
+#ifndef OVERDRAW_COUNTER_H
+#define OVERDRAW_COUNTER_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+
+// Fragments per pixel that reach the lighting shader, from GL_SAMPLES_PASSED
+// queries. With a depth pre-pass the pre-pass itself passes exactly the
+// fragments the shaded pass would shade without it, so one run measures both.
+// Results are read back at the end of each frame, which stalls until the GPU
+// is done, so this is meant for benchmark runs only.
+class OverdrawCounter
+{
+public:
+    enum Counter {
+        WITHOUT_PREPASS,
+        WITH_PREPASS,
+        COUNTER_COUNT
+    };
+
+    explicit OverdrawCounter(unsigned int pixelCount)
+        : pixels(pixelCount)
+    {
+        glGenQueries(COUNTER_COUNT, queries);
+    }
+
+    ~OverdrawCounter()
+    {
+        glDeleteQueries(COUNTER_COUNT, queries);
+    }
+
+    void Begin(Counter counter)
+    {
+        glBeginQuery(GL_SAMPLES_PASSED, queries[counter]);
+        used[counter] = true;
+    }
+
+    void End()
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+    }
+
+    void EndFrame()
+    {
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            if (!used[i])
+                continue;
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &samples);
+            totals[i] += samples;
+            frames[i]++;
+            used[i] = false;
+        }
+    }
+
+    void Print() const
+    {
+        std::printf("Shaded fragments per pixel: %.3f without depth pre-pass", PerPixel(WITHOUT_PREPASS));
+        if (frames[WITH_PREPASS] > 0)
+            std::printf(", %.3f with it\n", PerPixel(WITH_PREPASS));
+        else
+            std::printf(" (run with --z-prepass to compare)\n");
+    }
+
+private:
+    unsigned int pixels;
+    GLuint queries[COUNTER_COUNT] = {};
+    bool used[COUNTER_COUNT] = {};
+    GLuint64 totals[COUNTER_COUNT] = {};
+    unsigned int frames[COUNTER_COUNT] = {};
+
+    double PerPixel(Counter counter) const
+    {
+        return frames[counter] > 0 ? static_cast<double>(totals[counter]) / frames[counter] / pixels : 0.0;
+    }
+};
+#endif
@@ -34,16 +34,13 @@ public:
         }
     }
 
-    void HandleHKeyPress(GLFWwindow* window, Flashlight& flashlight, Camera& camera, const std::vector<glm::vec3>& firePositions) {
-        static bool hKeyPressedLastFrame = false;
-        bool hKeyPressedNow = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
-
-        if (hKeyPressedNow && !hKeyPressedLastFrame) {
+    // hKeyPressed is true only on the tick the key went down.
+    void HandleHKeyPress(bool hKeyPressed, Flashlight& flashlight, Camera& camera, const std::vector<glm::vec3>& firePositions) {
+        if (hKeyPressed) {
             if (!camera.neckAnimation.isActive) {
                 camera.StartNeckAnimation();
             }
         }
-        hKeyPressedLastFrame = hKeyPressedNow;
 
         if (camera.neckAnimation.animationCompleted) {
             if (sleepState == SLEEP) {
@@ -60,6 +57,11 @@ public:
         
     }
 
+    // Fixed seed so recorded sessions replay with the same sleep timings.
+    void Seed(unsigned int seed) {
+        gen.seed(seed);
+    }
+
     void RegisterFireActivation() {
         activatedFires++;
         GenerateNewSleepTrigger();
@@ -0,0 +1,389 @@
+#ifndef PORTAL_GRAPH_H
+#define PORTAL_GRAPH_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+// Cell-and-portal visibility for the maze. The level is split into square
+// cells on the XZ plane; two neighbouring cells are joined by a portal where
+// their shared edge is not walled off at eye height. FindVisibleCells walks
+// the portals from the eye's cell and narrows the screen rectangle at every
+// portal, so only cells that can really be seen through the corridors are
+// marked. Walls come from the level's near-vertical triangles rasterized
+// into a finer grid, SUBDIVISIONS samples per cell edge.
+class PortalGraph
+{
+public:
+    static const int SUBDIVISIONS = 8;
+
+    void Build(const std::vector<glm::vec3>& triangles, const AABB& area, float newCellSize, float eyeMinY, float eyeMaxY)
+    {
+        bounds = area;
+        cellSize = newCellSize;
+        countX = std::max(1, static_cast<int>(std::ceil((area.max.x - area.min.x) / cellSize)));
+        countZ = std::max(1, static_cast<int>(std::ceil((area.max.z - area.min.z) / cellSize)));
+
+        std::vector<uint8_t> walls;
+        RasterizeWalls(triangles, eyeMinY, eyeMaxY, walls);
+
+        int fineX = countX * SUBDIVISIONS;
+        float fine = cellSize / SUBDIVISIONS;
+        portalsX.assign(countX * countZ, Portal());
+        portalsZ.assign(countX * countZ, Portal());
+        portalCount = 0;
+        for (int z = 0; z < countZ; z++) {
+            for (int x = 0; x < countX; x++) {
+                // Edge to the +X neighbour: open where the fine samples on both sides are free.
+                if (x + 1 < countX) {
+                    int lo = SUBDIVISIONS, hi = -1;
+                    for (int j = 0; j < SUBDIVISIONS; j++) {
+                        int row = (z * SUBDIVISIONS + j) * fineX;
+                        if (!walls[row + (x + 1) * SUBDIVISIONS - 1] && !walls[row + (x + 1) * SUBDIVISIONS]) {
+                            lo = std::min(lo, j);
+                            hi = std::max(hi, j);
+                        }
+                    }
+                    if (lo <= hi) {
+                        float edge = area.min.x + (x + 1) * cellSize;
+                        float start = area.min.z + z * cellSize;
+                        portalsX[Index(x, z)] = { true, { glm::vec3(edge, area.min.y, start + lo * fine), glm::vec3(edge, area.max.y, start + (hi + 1) * fine) } };
+                        portalCount++;
+                    }
+                }
+                // Edge to the +Z neighbour.
+                if (z + 1 < countZ) {
+                    int lo = SUBDIVISIONS, hi = -1;
+                    for (int i = 0; i < SUBDIVISIONS; i++) {
+                        int column = x * SUBDIVISIONS + i;
+                        if (!walls[((z + 1) * SUBDIVISIONS - 1) * fineX + column] && !walls[((z + 1) * SUBDIVISIONS) * fineX + column]) {
+                            lo = std::min(lo, i);
+                            hi = std::max(hi, i);
+                        }
+                    }
+                    if (lo <= hi) {
+                        float edge = area.min.z + (z + 1) * cellSize;
+                        float start = area.min.x + x * cellSize;
+                        portalsZ[Index(x, z)] = { true, { glm::vec3(start + lo * fine, area.min.y, edge), glm::vec3(start + (hi + 1) * fine, area.max.y, edge) } };
+                        portalCount++;
+                    }
+                }
+            }
+        }
+
+        visible.assign(countX * countZ, 0);
+        seenRects.assign(countX * countZ, std::vector<glm::vec4>());
+        seenStamp.assign(countX * countZ, 0);
+        visibleSum.assign((countX + 1) * (countZ + 1), 0);
+        allVisible = true;
+    }
+
+    // Marks the cells seen from eye through the view of viewProjection. An eye
+    // outside the grid sees everything.
+    void FindVisibleCells(const glm::vec3& eye, const glm::mat4& viewProjection)
+    {
+        int start = CellAt(eye);
+        allVisible = start < 0;
+        if (allVisible)
+            return;
+
+        std::fill(visible.begin(), visible.end(), 0);
+        stamp++;
+        visibleCellCount = 0;
+
+        const glm::vec4 fullScreen(-1.0f, -1.0f, 1.0f, 1.0f);
+        seenRects[start].assign(1, fullScreen);
+        seenStamp[start] = stamp;
+        stack.clear();
+        stack.push_back({ start, fullScreen });
+        while (!stack.empty()) {
+            Visit current = stack.back();
+            stack.pop_back();
+            if (!visible[current.cell]) {
+                visible[current.cell] = 1;
+                visibleCellCount++;
+            }
+
+            int x = current.cell % countX, z = current.cell / countX;
+            const Portal* portals[4] = {
+                x + 1 < countX ? &portalsX[current.cell] : nullptr,
+                x > 0 ? &portalsX[current.cell - 1] : nullptr,
+                z + 1 < countZ ? &portalsZ[current.cell] : nullptr,
+                z > 0 ? &portalsZ[current.cell - countX] : nullptr
+            };
+            const int neighbours[4] = { current.cell + 1, current.cell - 1, current.cell + countX, current.cell - countX };
+            for (int i = 0; i < 4; i++) {
+                if (!portals[i] || !portals[i]->open)
+                    continue;
+                glm::vec4 rect;
+                if (!ProjectPortal(portals[i]->box, viewProjection, rect))
+                    continue;
+                rect = glm::vec4(std::max(rect.x, current.rect.x), std::max(rect.y, current.rect.y),
+                    std::min(rect.z, current.rect.z), std::min(rect.w, current.rect.w));
+                if (rect.x >= rect.z || rect.y >= rect.w)
+                    continue;
+
+                // Everything visible through rect was already found if one earlier
+                // visit of the neighbour covered it. The rectangles are kept apart
+                // rather than merged: their bounding box can span a gap no visit
+                // has looked through yet.
+                int next = neighbours[i];
+                std::vector<glm::vec4>& seen = seenRects[next];
+                if (seenStamp[next] != stamp) {
+                    seen.clear();
+                    seenStamp[next] = stamp;
+                }
+                if (std::any_of(seen.begin(), seen.end(), [&](const glm::vec4& s) { return Contains(s, rect); }))
+                    continue;
+                seen.erase(std::remove_if(seen.begin(), seen.end(), [&](const glm::vec4& s) { return Contains(rect, s); }), seen.end());
+                seen.push_back(rect);
+                stack.push_back({ next, rect });
+            }
+        }
+
+        // Summed-area table so a box of any size is tested in constant time.
+        for (int z = 0; z < countZ; z++)
+            for (int x = 0; x < countX; x++)
+                visibleSum[(z + 1) * (countX + 1) + x + 1] = visible[Index(x, z)] +
+                    visibleSum[z * (countX + 1) + x + 1] + visibleSum[(z + 1) * (countX + 1) + x] - visibleSum[z * (countX + 1) + x];
+    }
+
+    // True if box touches a visible cell or reaches outside the grid.
+    bool IsVisible(const AABB& box) const
+    {
+        if (allVisible)
+            return true;
+        if (box.min.x < bounds.min.x || box.min.z < bounds.min.z || box.max.x > bounds.max.x || box.max.z > bounds.max.z)
+            return true;
+        int minX = CellCoordinate(box.min.x, bounds.min.x, countX), maxX = CellCoordinate(box.max.x, bounds.min.x, countX);
+        int minZ = CellCoordinate(box.min.z, bounds.min.z, countZ), maxZ = CellCoordinate(box.max.z, bounds.min.z, countZ);
+        int stride = countX + 1;
+        int sum = visibleSum[(maxZ + 1) * stride + maxX + 1] - visibleSum[minZ * stride + maxX + 1] -
+            visibleSum[(maxZ + 1) * stride + minX] + visibleSum[minZ * stride + minX];
+        return sum > 0;
+    }
+
+    // Keeps only the indices whose boxes are visible; returns the new count.
+    size_t Filter(const AABBSoA& boxes, uint32_t* indices, size_t count) const
+    {
+        if (allVisible)
+            return count;
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            indices[kept] = indices[i];
+            kept += IsVisible(boxes.Get(indices[i])) ? 1 : 0;
+        }
+        return kept;
+    }
+
+    int GetCellCount() const { return countX * countZ; }
+    int GetPortalCount() const { return portalCount; }
+    int GetVisibleCellCount() const { return allVisible ? GetCellCount() : visibleCellCount; }
+
+private:
+    struct Portal {
+        bool open = false;
+        AABB box = { glm::vec3(0.0f), glm::vec3(0.0f) };   // flat rectangle on the shared edge
+    };
+
+    struct Visit {
+        int cell;
+        glm::vec4 rect;     // NDC min x, min y, max x, max y
+    };
+
+    AABB bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    float cellSize = 1.0f;
+    int countX = 0, countZ = 0;
+    int portalCount = 0;
+    std::vector<Portal> portalsX;   // edge between cell and its +X neighbour
+    std::vector<Portal> portalsZ;   // edge between cell and its +Z neighbour
+
+    std::vector<uint8_t> visible;
+    std::vector<int> visibleSum;
+    std::vector<std::vector<glm::vec4>> seenRects;     // rectangles already pushed per cell this stamp
+    std::vector<unsigned> seenStamp;
+    std::vector<Visit> stack;
+    unsigned stamp = 0;
+    int visibleCellCount = 0;
+    bool allVisible = true;
+
+    int Index(int x, int z) const { return z * countX + x; }
+
+    static bool Contains(const glm::vec4& outer, const glm::vec4& inner)
+    {
+        return inner.x >= outer.x && inner.y >= outer.y && inner.z <= outer.z && inner.w <= outer.w;
+    }
+
+    static int CellCoordinate(float value, float origin, float size, int count)
+    {
+        return std::min(count - 1, std::max(0, static_cast<int>(std::floor((value - origin) / size))));
+    }
+
+    int CellCoordinate(float value, float origin, int count) const
+    {
+        return CellCoordinate(value, origin, cellSize, count);
+    }
+
+    int CellAt(const glm::vec3& point) const
+    {
+        if (point.x < bounds.min.x || point.z < bounds.min.z || point.x > bounds.max.x || point.z > bounds.max.z)
+            return -1;
+        return Index(CellCoordinate(point.x, bounds.min.x, countX), CellCoordinate(point.z, bounds.min.z, countZ));
+    }
+
+    // Screen rectangle covered by a portal. The portal quad is clipped to the
+    // part in front of the eye first, so portals beside the eye still project
+    // to a tight rectangle.
+    static bool ProjectPortal(const AABB& box, const glm::mat4& viewProjection, glm::vec4& rect)
+    {
+        const float EPSILON = 1e-4f;
+        glm::vec3 corners[4];
+        if (box.min.x == box.max.x) {
+            corners[0] = glm::vec3(box.min.x, box.min.y, box.min.z);
+            corners[1] = glm::vec3(box.min.x, box.min.y, box.max.z);
+            corners[2] = glm::vec3(box.min.x, box.max.y, box.max.z);
+            corners[3] = glm::vec3(box.min.x, box.max.y, box.min.z);
+        }
+        else {
+            corners[0] = glm::vec3(box.min.x, box.min.y, box.min.z);
+            corners[1] = glm::vec3(box.max.x, box.min.y, box.min.z);
+            corners[2] = glm::vec3(box.max.x, box.max.y, box.min.z);
+            corners[3] = glm::vec3(box.min.x, box.max.y, box.min.z);
+        }
+
+        glm::vec4 clip[4];
+        for (int i = 0; i < 4; i++)
+            clip[i] = viewProjection * glm::vec4(corners[i], 1.0f);
+
+        glm::vec2 lo(FLT_MAX), hi(-FLT_MAX);
+        int projected = 0;
+        for (int i = 0; i < 4; i++) {
+            const glm::vec4& a = clip[i];
+            const glm::vec4& b = clip[(i + 1) % 4];
+            if (a.w > EPSILON) {
+                glm::vec2 ndc = glm::vec2(a.x, a.y) / a.w;
+                lo = glm::min(lo, ndc);
+                hi = glm::max(hi, ndc);
+                projected++;
+            }
+            if ((a.w > EPSILON) != (b.w > EPSILON)) {
+                glm::vec4 crossing = a + (b - a) * ((EPSILON - a.w) / (b.w - a.w));
+                glm::vec2 ndc = glm::vec2(crossing.x, crossing.y) / EPSILON;
+                lo = glm::min(lo, ndc);
+                hi = glm::max(hi, ndc);
+                projected++;
+            }
+        }
+        if (projected == 0)
+            return false;
+        rect = glm::vec4(std::max(lo.x, -1.0f), std::max(lo.y, -1.0f), std::min(hi.x, 1.0f), std::min(hi.y, 1.0f));
+        return rect.x < rect.z && rect.y < rect.w;
+    }
+
+    // Marks every fine sample touched by a wall between eyeMinY and eyeMaxY.
+    void RasterizeWalls(const std::vector<glm::vec3>& triangles, float eyeMinY, float eyeMaxY, std::vector<uint8_t>& walls) const
+    {
+        int fineX = countX * SUBDIVISIONS, fineZ = countZ * SUBDIVISIONS;
+        float fine = cellSize / SUBDIVISIONS;
+        walls.assign(fineX * fineZ, 0);
+
+        for (size_t t = 0; t + 2 < triangles.size(); t += 3) {
+            glm::vec3 normal = glm::cross(triangles[t + 1] - triangles[t], triangles[t + 2] - triangles[t]);
+            float length = glm::length(normal);
+            if (length < 1e-8f || std::fabs(normal.y) > 0.7f * length)
+                continue;   // degenerate, floor or ceiling
+
+            glm::vec2 polygon[5];
+            int count = ClipToBand(&triangles[t], eyeMinY, eyeMaxY, polygon);
+            if (count < 2)
+                continue;
+
+            glm::vec2 lo = polygon[0], hi = polygon[0];
+            for (int i = 1; i < count; i++) {
+                lo = glm::min(lo, polygon[i]);
+                hi = glm::max(hi, polygon[i]);
+            }
+            int minX = CellCoordinate(lo.x, bounds.min.x, fine, fineX), maxX = CellCoordinate(hi.x, bounds.min.x, fine, fineX);
+            int minZ = CellCoordinate(lo.y, bounds.min.z, fine, fineZ), maxZ = CellCoordinate(hi.y, bounds.min.z, fine, fineZ);
+            for (int z = minZ; z <= maxZ; z++) {
+                for (int x = minX; x <= maxX; x++) {
+                    glm::vec2 cellMin(bounds.min.x + x * fine, bounds.min.z + z * fine);
+                    if (!walls[z * fineX + x] && PolygonOverlapsRect(polygon, count, cellMin, cellMin + glm::vec2(fine)))
+                        walls[z * fineX + x] = 1;
+                }
+            }
+        }
+    }
+
+    // The part of a triangle between two heights, projected onto XZ.
+    static int ClipToBand(const glm::vec3* triangle, float minY, float maxY, glm::vec2* result)
+    {
+        glm::vec3 input[5], output[5];
+        int count = 3;
+        for (int i = 0; i < 3; i++)
+            input[i] = triangle[i];
+        count = ClipAgainst(input, count, output, minY, 1.0f);
+        count = ClipAgainst(output, count, input, maxY, -1.0f);
+        for (int i = 0; i < count; i++)
+            result[i] = glm::vec2(input[i].x, input[i].z);
+        return count;
+    }
+
+    // Keeps the part of polygon with side * (y - height) >= 0.
+    static int ClipAgainst(const glm::vec3* polygon, int count, glm::vec3* result, float height, float side)
+    {
+        int written = 0;
+        for (int i = 0; i < count; i++) {
+            const glm::vec3& a = polygon[i];
+            const glm::vec3& b = polygon[(i + 1) % count];
+            float da = side * (a.y - height), db = side * (b.y - height);
+            if (da >= 0.0f)
+                result[written++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+                result[written++] = a + (b - a) * (da / (da - db));
+        }
+        return written;
+    }
+
+    // Separating-axis test of a convex polygon (possibly a segment) against a rectangle.
+    static bool PolygonOverlapsRect(const glm::vec2* polygon, int count, const glm::vec2& rectMin, const glm::vec2& rectMax)
+    {
+        glm::vec2 lo = polygon[0], hi = polygon[0];
+        for (int i = 1; i < count; i++) {
+            lo = glm::min(lo, polygon[i]);
+            hi = glm::max(hi, polygon[i]);
+        }
+        if (hi.x < rectMin.x || lo.x > rectMax.x || hi.y < rectMin.y || lo.y > rectMax.y)
+            return false;
+
+        glm::vec2 corners[4] = { rectMin, glm::vec2(rectMax.x, rectMin.y), rectMax, glm::vec2(rectMin.x, rectMax.y) };
+        for (int i = 0; i < count; i++) {
+            glm::vec2 edge = polygon[(i + 1) % count] - polygon[i];
+            glm::vec2 axis(-edge.y, edge.x);
+            if (glm::dot(axis, axis) < 1e-12f)
+                continue;
+            float polygonMin = FLT_MAX, polygonMax = -FLT_MAX;
+            for (int j = 0; j < count; j++) {
+                float d = glm::dot(axis, polygon[j]);
+                polygonMin = std::min(polygonMin, d);
+                polygonMax = std::max(polygonMax, d);
+            }
+            float rectLo = FLT_MAX, rectHi = -FLT_MAX;
+            for (const glm::vec2& corner : corners) {
+                float d = glm::dot(axis, corner);
+                rectLo = std::min(rectLo, d);
+                rectHi = std::max(rectHi, d);
+            }
+            if (polygonMax < rectLo || polygonMin > rectHi)
+                return false;
+        }
+        return true;
+    }
+};
+#endif
@@ -8,12 +8,32 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 class Shader
 {
 public:
+    // Uniform location resolved once; -1 when the program has no such uniform.
+    struct Uniform {
+        GLint location = -1;
+    };
+
+    // Uniforms the scene draw path sets on every draw. They are resolved once
+    // when the program is linked, so drawing never looks a name up.
+    struct DrawUniforms {
+        Uniform model;
+        Uniform normalMatrix;       // world-space lighting variants only
+        Uniform instanced;
+        // Quantized vertex decode, set per Model (see VertexFormat.h).
+        Uniform positionOffset;
+        Uniform positionScale;
+        Uniform texCoordRange;
+    };
+
     unsigned int ID;
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // Each name in defines becomes "#define <name>" at the top of both stages.
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {})
     {
         std::string vertexCode;
         std::string fragmentCode;
@@ -37,6 +57,8 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
         }
+        vertexCode = injectDefines(vertexCode, defines);
+        fragmentCode = injectDefines(fragmentCode, defines);
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
         unsigned int vertex, fragment;
@@ -55,62 +77,184 @@ public:
         checkCompileErrors(ID, "PROGRAM");
         glDeleteShader(vertex);
         glDeleteShader(fragment);
-
+        reflectUniforms();
+        drawUniforms.model = getUniform("model");
+        drawUniforms.normalMatrix = getUniform("normalMatrix");
+        drawUniforms.instanced = getUniform("instanced");
+        drawUniforms.positionOffset = getUniform("positionOffset");
+        drawUniforms.positionScale = getUniform("positionScale");
+        drawUniforms.texCoordRange = getUniform("texCoordRange");
     }
     void use() const
     {
         glUseProgram(ID);
     }
+    const DrawUniforms& getDrawUniforms() const
+    {
+        return drawUniforms;
+    }
+    Uniform getUniform(const std::string& name) const
+    {
+        Uniform uniform;
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end())
+            uniform.location = it->second;
+        return uniform;
+    }
+    // Attaches a uniform block to a binding point; does nothing if the program has no such block.
+    void bindUniformBlock(const char* name, GLuint binding) const
+    {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniform(name).location, (int)value);
+    }
+    void setBool(Uniform uniform, bool value) const
+    {
+        glUniform1i(uniform.location, (int)value);
     }
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniform(name).location, value);
+    }
+    void setInt(Uniform uniform, int value) const
+    {
+        glUniform1i(uniform.location, value);
     }
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniform(name).location, value);
+    }
+    void setFloat(Uniform uniform, float value) const
+    {
+        glUniform1f(uniform.location, value);
     }
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniform(name).location, 1, &value[0]);
+    }
+    void setVec2(Uniform uniform, const glm::vec2& value) const
+    {
+        glUniform2fv(uniform.location, 1, &value[0]);
     }
     void setVec2(const std::string& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniform(name).location, x, y);
+    }
+    void setVec2(Uniform uniform, float x, float y) const
+    {
+        glUniform2f(uniform.location, x, y);
     }
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniform(name).location, 1, &value[0]);
+    }
+    void setVec3(Uniform uniform, const glm::vec3& value) const
+    {
+        glUniform3fv(uniform.location, 1, &value[0]);
     }
     void setVec3(const std::string& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniform(name).location, x, y, z);
+    }
+    void setVec3(Uniform uniform, float x, float y, float z) const
+    {
+        glUniform3f(uniform.location, x, y, z);
     }
     void setVec4(const std::string& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniform(name).location, 1, &value[0]);
+    }
+    void setVec4(Uniform uniform, const glm::vec4& value) const
+    {
+        glUniform4fv(uniform.location, 1, &value[0]);
     }
     void setVec4(const std::string& name, float x, float y, float z, float w) const
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniform(name).location, x, y, z, w);
+    }
+    void setVec4(Uniform uniform, float x, float y, float z, float w) const
+    {
+        glUniform4f(uniform.location, x, y, z, w);
     }
     void setMat2(const std::string& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniform(name).location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat2(Uniform uniform, const glm::mat2& mat) const
+    {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
     void setMat3(const std::string& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniform(name).location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(Uniform uniform, const glm::mat3& mat) const
+    {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
     void setMat4(const std::string& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniform(name).location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(Uniform uniform, const glm::mat4& mat) const
+    {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+    DrawUniforms drawUniforms;
+
+    // Fills the name -> location table from the linked program. Array elements
+    // are registered individually ("lights[2]") as well as under the bare name.
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string buffer(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, i, static_cast<GLsizei>(buffer.size()), &length, &size, &type, &buffer[0]);
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue;  // member of a uniform block
+            uniformLocations[name] = location;
+
+            size_t bracket = name.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == name.size()) {
+                std::string base = name.substr(0, bracket);
+                uniformLocations[base] = location;
+                for (GLint element = 1; element < size; element++) {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+    }
+
+    // The defines go right after the #version line, which must stay first; #line
+    // keeps compiler messages pointing at the lines of the file.
+    static std::string injectDefines(const std::string& code, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t versionEnd = code.find('\n', code.find("#version"));
+        if (versionEnd == std::string::npos)
+            return code;
+        std::string injected;
+        for (const std::string& define : defines)
+            injected += "#define " + define + "\n";
+        injected += "#line 2\n";
+        return code.substr(0, versionEnd + 1) + injected + code.substr(versionEnd + 1);
+    }
 
     void checkCompileErrors(GLuint shader, std::string type)
     {
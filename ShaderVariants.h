@@ -0,0 +1,67 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "Shader.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Compiled specializations of one vertex/fragment pair. A variant is keyed by
+// a bit mask; bit i set adds "#define <featureDefines[i]>" to both stages.
+// Variants are compiled on first use and kept for the life of the cache, and
+// setup runs once on every new program with its mask (samplers, uniform block
+// bindings, handles the caller keeps per variant).
+class ShaderVariants
+{
+public:
+    ShaderVariants(const char* vertexPath, const char* fragmentPath, std::vector<std::string> featureDefines,
+        std::function<void(Shader&, unsigned int)> setup)
+        : vertexPath(vertexPath), fragmentPath(fragmentPath), featureDefines(std::move(featureDefines)), setup(std::move(setup))
+    {
+    }
+
+    Shader& Get(unsigned int features)
+    {
+        auto found = variants.find(features);
+        if (found != variants.end())
+            return *found->second;
+
+        std::vector<std::string> defines;
+        for (size_t i = 0; i < featureDefines.size(); i++)
+            if (features & (1u << i))
+                defines.push_back(featureDefines[i]);
+        std::unique_ptr<Shader> shader(new Shader(vertexPath.c_str(), fragmentPath.c_str(), defines));
+        shader->use();
+        if (setup)
+            setup(*shader, features);
+        return *variants.emplace(features, std::move(shader)).first->second;
+    }
+
+    // Compiles every combination of the variable features up front, each with
+    // fixedFeatures added, so no variant is built mid-game. Features chosen
+    // once per run go in fixedFeatures; by default all features vary. Masks
+    // reachable rejects are never selected and are skipped.
+    void Warm(unsigned int fixedFeatures = 0, unsigned int variableFeatures = ~0u,
+        const std::function<bool(unsigned int)>& reachable = nullptr)
+    {
+        variableFeatures &= (1u << featureDefines.size()) - 1;
+        for (unsigned int features = variableFeatures;; features = (features - 1) & variableFeatures) {
+            if (!reachable || reachable(features | fixedFeatures))
+                Get(features | fixedFeatures);
+            if (features == 0)
+                break;
+        }
+    }
+
+    size_t GetCompiledCount() const { return variants.size(); }
+
+private:
+    std::string vertexPath, fragmentPath;
+    std::vector<std::string> featureDefines;
+    std::function<void(Shader&, unsigned int)> setup;
+    std::unordered_map<unsigned int, std::unique_ptr<Shader>> variants;
+};
+#endif
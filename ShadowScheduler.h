@@ -0,0 +1,86 @@
+#ifndef SHADOW_SCHEDULER_H
+#define SHADOW_SCHEDULER_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+enum ShadowUpdate {
+    SHADOW_SKIP,      // light is off, nothing samples the map
+    SHADOW_REUSE,     // the map still holds this frame's shadows, or close enough
+    SHADOW_RENDER
+};
+
+// Decides per frame whether the flashlight's shadow map has to be redrawn.
+// A reused map is always sampled with the light matrix it was rendered with,
+// so a slightly stale map still lines up with the scene; only the shadow
+// shapes lag behind the light by at most maxReuseFrames frames.
+class ShadowScheduler
+{
+public:
+    // Reduced rate updates while the light moves less than these since the
+    // last render. maxReuseFrames = 0 redraws whenever anything changed.
+    int maxReuseFrames = 0;
+    float reuseDistance = 0.0f;
+    float reuseAngle = 0.0f;    // degrees
+
+    ShadowUpdate Update(bool lightOn, const glm::mat4& lightSpaceMatrix, const glm::vec3& lightPosition,
+        const glm::vec3& lightDirection, unsigned int casterVersion)
+    {
+        if (!lightOn) {
+            skipped++;
+            return SHADOW_SKIP;
+        }
+        if (valid && casterVersion == renderedCasterVersion) {
+            if (SameMatrix(lightSpaceMatrix, renderedMatrix)) {
+                reused++;
+                return SHADOW_REUSE;
+            }
+            bool slow = glm::distance(lightPosition, renderedPosition) < reuseDistance &&
+                glm::dot(lightDirection, renderedDirection) > glm::cos(glm::radians(reuseAngle));
+            if (slow && framesSinceRender < maxReuseFrames) {
+                framesSinceRender++;
+                reused++;
+                return SHADOW_REUSE;
+            }
+        }
+        valid = true;
+        renderedMatrix = lightSpaceMatrix;
+        renderedPosition = lightPosition;
+        renderedDirection = lightDirection;
+        renderedCasterVersion = casterVersion;
+        framesSinceRender = 0;
+        rendered++;
+        return SHADOW_RENDER;
+    }
+
+    // The matrix the map currently holds; sample with this one.
+    const glm::mat4& GetLightSpaceMatrix() const
+    {
+        return renderedMatrix;
+    }
+
+    size_t GetRenderedCount() const { return rendered; }
+    size_t GetReusedCount() const { return reused; }
+    size_t GetSkippedCount() const { return skipped; }
+
+private:
+    bool valid = false;
+    glm::mat4 renderedMatrix = glm::mat4(1.0f);
+    glm::vec3 renderedPosition = glm::vec3(0.0f);
+    glm::vec3 renderedDirection = glm::vec3(0.0f, 0.0f, -1.0f);
+    unsigned int renderedCasterVersion = 0;
+    int framesSinceRender = 0;
+
+    size_t rendered = 0, reused = 0, skipped = 0;
+
+    static bool SameMatrix(const glm::mat4& a, const glm::mat4& b)
+    {
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                if (a[column][row] != b[column][row])
+                    return false;
+        return true;
+    }
+};
+#endif
@@ -0,0 +1,123 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+enum InputKey {
+    KEY_FORWARD,
+    KEY_BACKWARD,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_JUMP,
+    KEY_INTERACT,
+    KEY_FLASHLIGHT,
+    KEY_NECK,
+    INPUT_KEY_COUNT
+};
+
+// Input sampled on the window thread. Mouse is a running total so the
+// simulation never loses movement when it skips an intermediate sample.
+struct InputState {
+    bool keys[INPUT_KEY_COUNT] = {};
+    double mouseX = 0.0;
+    double mouseY = 0.0;
+
+    bool Pressed(InputKey key, const InputState& previous) const
+    {
+        return keys[key] && !previous.keys[key];
+    }
+};
+
+// Runs game logic at a fixed rate on its own thread. Input arrives from the
+// window thread through a triple buffer; the tick callback publishes whatever
+// the renderer needs the same way.
+class Simulation
+{
+public:
+    typedef std::function<void(const InputState& input, const InputState& previous, float dt, double tickTime)> TickFunction;
+
+    // After a stall longer than this the simulation drops ticks instead of catching up.
+    static constexpr double MAX_LAG = 0.25;
+
+    ~Simulation()
+    {
+        Stop();
+    }
+
+    void Start(float rate, TickFunction tickFunction)
+    {
+        step = 1.0 / rate;
+        tick = tickFunction;
+        running = true;
+        thread = std::thread(&Simulation::Run, this);
+    }
+
+    void Stop()
+    {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void SetPaused(bool value)
+    {
+        paused = value;
+    }
+
+    void SubmitInput(const InputState& input)
+    {
+        inputs.Write() = input;
+        inputs.Publish();
+    }
+
+    float GetStep() const { return static_cast<float>(step); }
+
+    // Seconds on the clock the tick times are measured with.
+    static double Now()
+    {
+        static const auto epoch = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+private:
+    TripleBuffer<InputState> inputs;
+    TickFunction tick;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::atomic<bool> paused{ false };
+    double step = 1.0 / 120.0;
+
+    void Run()
+    {
+        InputState previous = inputs.Read();
+        double next = Now();
+        while (running) {
+            const InputState& input = inputs.Read();
+            double now = Now();
+
+            if (paused) {
+                // Keep the baseline current so resuming does not replay input from the menu.
+                previous = input;
+                next = now;
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                continue;
+            }
+            if (now < next) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+                continue;
+            }
+            if (now - next > MAX_LAG)
+                next = now;
+
+            tick(input, previous, static_cast<float>(step), next);
+            previous = input;
+            next += step;
+        }
+    }
+};
+#endif
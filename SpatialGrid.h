@@ -0,0 +1,154 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <glm/glm.hpp>
+#include "AABB.h"
+#include "AABBSoA.h"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+// Uniform spatial hash on the XZ plane for an axis-aligned grid world.
+// Every box is stored in each cell it overlaps, so a query only visits the
+// buckets around the query box (the 3x3 neighbourhood of the player's cell
+// when the cell size is at least the size of the player box).
+class SpatialGrid
+{
+public:
+    // Boxes spanning more cells than this (floors, ceilings) are kept in a
+    // separate list that every query checks, instead of filling the whole table.
+    static const int MAX_CELLS_PER_BOX = 256;
+
+    void Build(const std::vector<AABB>& boxes, float newCellSize = 0.0f)
+    {
+        cellSize = newCellSize > 0.0f ? newCellSize : ChooseCellSize(boxes);
+
+        std::vector<int> oversized;
+        std::unordered_map<unsigned long long, std::vector<int>> buckets;
+        for (size_t i = 0; i < boxes.size(); i++) {
+            int minX, minZ, maxX, maxZ;
+            CellRange(boxes[i], minX, minZ, maxX, maxZ);
+            long long cellCount = static_cast<long long>(maxX - minX + 1) * (maxZ - minZ + 1);
+            if (cellCount > MAX_CELLS_PER_BOX) {
+                oversized.push_back(static_cast<int>(i));
+                continue;
+            }
+            for (int x = minX; x <= maxX; x++)
+                for (int z = minZ; z <= maxZ; z++)
+                    buckets[Key(x, z)].push_back(static_cast<int>(i));
+        }
+
+        // Every bucket is copied into one contiguous SoA range (boxes in several
+        // cells are duplicated), the oversized list comes first.
+        cells.clear();
+        packedBoxes.Clear();
+        packedIndices.clear();
+        for (int index : oversized)
+            Pack(boxes, index);
+        oversizedRange = { 0, static_cast<uint32_t>(oversized.size()) };
+        for (const auto& bucket : buckets) {
+            Range range = { static_cast<uint32_t>(packedIndices.size()), static_cast<uint32_t>(bucket.second.size()) };
+            for (int index : bucket.second)
+                Pack(boxes, index);
+            cells[bucket.first] = range;
+        }
+    }
+
+    float GetCellSize() const { return cellSize; }
+
+    size_t GetCellCount() const { return cells.size(); }
+
+    bool Overlaps(const AABB& box) const
+    {
+        if (packedBoxes.AnyOverlap(box, oversizedRange.first, oversizedRange.count))
+            return true;
+
+        int minX, minZ, maxX, maxZ;
+        CellRange(box, minX, minZ, maxX, maxZ);
+        for (int x = minX; x <= maxX; x++) {
+            for (int z = minZ; z <= maxZ; z++) {
+                auto it = cells.find(Key(x, z));
+                if (it != cells.end() && packedBoxes.AnyOverlap(box, it->second.first, it->second.count))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // Appends overlapping box indices; a box spanning several visited cells is reported once.
+    void Query(const AABB& box, std::vector<int>& result) const
+    {
+        size_t first = result.size();
+        QueryRange(box, oversizedRange, result);
+
+        int minX, minZ, maxX, maxZ;
+        CellRange(box, minX, minZ, maxX, maxZ);
+        for (int x = minX; x <= maxX; x++) {
+            for (int z = minZ; z <= maxZ; z++) {
+                auto it = cells.find(Key(x, z));
+                if (it != cells.end())
+                    QueryRange(box, it->second, result);
+            }
+        }
+        std::sort(result.begin() + first, result.end());
+        result.erase(std::unique(result.begin() + first, result.end()), result.end());
+    }
+
+private:
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::unordered_map<unsigned long long, Range> cells;
+    Range oversizedRange = { 0, 0 };
+    AABBSoA packedBoxes;
+    std::vector<int> packedIndices;
+    float cellSize = 1.0f;
+
+    void Pack(const std::vector<AABB>& boxes, int index)
+    {
+        packedBoxes.Add(boxes[index]);
+        packedIndices.push_back(index);
+    }
+
+    void QueryRange(const AABB& box, const Range& range, std::vector<int>& result) const
+    {
+        uint32_t hits[64];
+        for (uint32_t i = range.first; i < range.first + range.count; i += 64) {
+            uint32_t block = std::min<uint32_t>(64, range.first + range.count - i);
+            size_t hitCount = packedBoxes.Overlaps(box, i, block, hits);
+            for (size_t h = 0; h < hitCount; h++)
+                result.push_back(packedIndices[hits[h]]);
+        }
+    }
+
+    static unsigned long long Key(int x, int z)
+    {
+        return (static_cast<unsigned long long>(static_cast<unsigned int>(x)) << 32) | static_cast<unsigned int>(z);
+    }
+
+    void CellRange(const AABB& box, int& minX, int& minZ, int& maxX, int& maxZ) const
+    {
+        minX = static_cast<int>(std::floor(box.min.x / cellSize));
+        minZ = static_cast<int>(std::floor(box.min.z / cellSize));
+        maxX = static_cast<int>(std::floor(box.max.x / cellSize));
+        maxZ = static_cast<int>(std::floor(box.max.z / cellSize));
+    }
+
+    // Median horizontal wall extent: most walls then land in one or two cells.
+    static float ChooseCellSize(const std::vector<AABB>& boxes)
+    {
+        if (boxes.empty())
+            return 8.0f;
+        std::vector<float> extents;
+        extents.reserve(boxes.size());
+        for (const auto& box : boxes)
+            extents.push_back(std::max(box.max.x - box.min.x, box.max.z - box.min.z));
+        std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+        return std::max(extents[extents.size() / 2], 4.0f);
+    }
+};
+#endif
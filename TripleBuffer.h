@@ -0,0 +1,41 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free single-producer/single-consumer triple buffer. The writer fills
+// Write() and calls Publish(); the reader calls Read() and always gets the
+// newest published value without ever blocking or waiting on the writer.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side. The slot holds stale data, so overwrite every field.
+    T& Write()
+    {
+        return slots[back];
+    }
+
+    void Publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // Reader side. Returns the same value until something newer is published.
+    const T& Read()
+    {
+        if (middle.load(std::memory_order_acquire) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        return slots[front];
+    }
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+
+    T slots[3];
+    std::atomic<int> middle{ 1 };
+    int back = 0;   // owned by the writer
+    int front = 2;  // owned by the reader
+};
+#endif
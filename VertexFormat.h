@@ -0,0 +1,194 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+// GPU vertex layouts. Both feed the same shader inputs:
+//   location 0  vec4 position; xyz dequantized with positionOffset/positionScale,
+//               w is the tangent handedness (0 means -1, 1 means +1)
+//   location 1  vec4 octahedral normal in xy, octahedral tangent in zw
+//   location 2  vec2 texture coordinates, dequantized with texCoordRange
+enum VertexFormat {
+    VERTEX_FORMAT_FLOAT,    // 32 bytes, full float positions and UVs
+    VERTEX_FORMAT_PACKED    // 20 bytes, 16-bit positions and UVs over the model's range
+};
+
+struct FloatVertex {
+    glm::vec4 position;
+    int16_t normalTangent[4];
+    glm::vec2 texCoords;
+};
+
+struct PackedVertex {
+    uint16_t position[4];
+    int16_t normalTangent[4];
+    uint16_t texCoords[2];
+};
+
+// Position-only stream for depth passes, quantized like the full vertex:
+// 12 bytes in float models, 8 in packed ones (w is padding).
+struct PackedPosition {
+    uint16_t position[4];
+};
+
+// Maps the stored values back to model space: value = offset + stored * scale.
+struct VertexQuantization {
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec2 texCoordOffset = glm::vec2(0.0f);
+    glm::vec2 texCoordScale = glm::vec2(1.0f);
+};
+
+inline GLsizei VertexStride(VertexFormat format)
+{
+    return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(FloatVertex);
+}
+
+inline GLsizei PositionStride(VertexFormat format)
+{
+    return format == VERTEX_FORMAT_PACKED ? sizeof(PackedPosition) : sizeof(glm::vec3);
+}
+
+// Octahedral mapping of a unit vector onto [-1, 1]^2.
+inline glm::vec2 OctahedralEncode(glm::vec3 v)
+{
+    float length = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+    if (length == 0.0f)
+        return glm::vec2(0.0f);
+    v /= length;
+    if (v.z >= 0.0f)
+        return glm::vec2(v.x, v.y);
+    return glm::vec2((1.0f - std::fabs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f),
+        (1.0f - std::fabs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+inline int16_t ToSnorm16(float value)
+{
+    return static_cast<int16_t>(std::lround(std::min(1.0f, std::max(-1.0f, value)) * 32767.0f));
+}
+
+inline uint16_t ToUnorm16(float value)
+{
+    return static_cast<uint16_t>(std::lround(std::min(1.0f, std::max(0.0f, value)) * 65535.0f));
+}
+
+inline void PackNormalTangent(const Vertex& vertex, int16_t* normalTangent)
+{
+    glm::vec2 normal = OctahedralEncode(vertex.Normal);
+    glm::vec2 tangent = OctahedralEncode(vertex.Tangent);
+    normalTangent[0] = ToSnorm16(normal.x);
+    normalTangent[1] = ToSnorm16(normal.y);
+    normalTangent[2] = ToSnorm16(tangent.x);
+    normalTangent[3] = ToSnorm16(tangent.y);
+}
+
+// Offset and scale that spread positions and UVs inside the given bounds over
+// the full 16-bit range.
+inline VertexQuantization QuantizationFor(const AABB& positions, const glm::vec2& texCoordMin, const glm::vec2& texCoordMax)
+{
+    VertexQuantization quantization;
+    quantization.positionOffset = positions.min;
+    quantization.positionScale = glm::max(positions.max - positions.min, glm::vec3(1e-6f));
+    quantization.texCoordOffset = texCoordMin;
+    quantization.texCoordScale = glm::max(texCoordMax - texCoordMin, glm::vec2(1e-6f));
+    return quantization;
+}
+
+// Appends vertices in format to out as raw bytes.
+inline void PackVertices(const std::vector<Vertex>& vertices, VertexFormat format, const VertexQuantization& quantization,
+    std::vector<unsigned char>& out)
+{
+    size_t start = out.size();
+    out.resize(start + vertices.size() * VertexStride(format));
+    unsigned char* destination = out.data() + start;
+    for (const Vertex& vertex : vertices) {
+        float handedness = vertex.TangentSign < 0.0f ? 0.0f : 1.0f;
+        if (format == VERTEX_FORMAT_PACKED) {
+            PackedVertex packed;
+            glm::vec3 position = (vertex.Position - quantization.positionOffset) / quantization.positionScale;
+            glm::vec2 texCoords = (vertex.TexCoords - quantization.texCoordOffset) / quantization.texCoordScale;
+            packed.position[0] = ToUnorm16(position.x);
+            packed.position[1] = ToUnorm16(position.y);
+            packed.position[2] = ToUnorm16(position.z);
+            packed.position[3] = ToUnorm16(handedness);
+            PackNormalTangent(vertex, packed.normalTangent);
+            packed.texCoords[0] = ToUnorm16(texCoords.x);
+            packed.texCoords[1] = ToUnorm16(texCoords.y);
+            std::memcpy(destination, &packed, sizeof(packed));
+            destination += sizeof(packed);
+        }
+        else {
+            FloatVertex full;
+            full.position = glm::vec4(vertex.Position, handedness);
+            PackNormalTangent(vertex, full.normalTangent);
+            full.texCoords = vertex.TexCoords;
+            std::memcpy(destination, &full, sizeof(full));
+            destination += sizeof(full);
+        }
+    }
+}
+
+// Appends the positions of vertices in format to out as raw bytes.
+inline void PackPositions(const std::vector<Vertex>& vertices, VertexFormat format, const VertexQuantization& quantization,
+    std::vector<unsigned char>& out)
+{
+    size_t start = out.size();
+    out.resize(start + vertices.size() * PositionStride(format));
+    unsigned char* destination = out.data() + start;
+    for (const Vertex& vertex : vertices) {
+        if (format == VERTEX_FORMAT_PACKED) {
+            PackedPosition packed;
+            glm::vec3 position = (vertex.Position - quantization.positionOffset) / quantization.positionScale;
+            packed.position[0] = ToUnorm16(position.x);
+            packed.position[1] = ToUnorm16(position.y);
+            packed.position[2] = ToUnorm16(position.z);
+            packed.position[3] = 0;
+            std::memcpy(destination, &packed, sizeof(packed));
+            destination += sizeof(packed);
+        }
+        else {
+            std::memcpy(destination, &vertex.Position, sizeof(glm::vec3));
+            destination += sizeof(glm::vec3);
+        }
+    }
+}
+
+// Points attribute 0 of the bound VAO at the bound position-only buffer.
+inline void SetupPositionAttribute(VertexFormat format)
+{
+    glEnableVertexAttribArray(0);
+    if (format == VERTEX_FORMAT_PACKED)
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (void*)offsetof(PackedPosition, position));
+    else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+}
+
+// Points attributes 0-2 of the bound VAO at the bound vertex buffer.
+inline void SetupVertexAttributes(VertexFormat format)
+{
+    GLsizei stride = VertexStride(format);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    if (format == VERTEX_FORMAT_PACKED) {
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, position));
+        glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normalTangent));
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, texCoords));
+    }
+    else {
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, position));
+        glVertexAttribPointer(1, 4, GL_SHORT, GL_TRUE, stride, (void*)offsetof(FloatVertex, normalTangent));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(FloatVertex, texCoords));
+    }
+}
+#endif
@@ -1,9 +1,20 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPos;
+layout (location = 7) in mat4 aInstanceModel;
 
-uniform mat4 lightSpaceMatrix;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    mat4 lightSpaceMatrix;
+    vec3 viewPos;
+};
 uniform mat4 model;
+uniform bool instanced;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
 
 void main() {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    mat4 modelMatrix = instanced ? aInstanceModel : model;
+    gl_Position = lightSpaceMatrix * modelMatrix * vec4(positionOffset + aPos.xyz * positionScale, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec4 aPos;
+layout (location = 7) in mat4 aInstanceModel;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    mat4 lightSpaceMatrix;
+    vec3 viewPos;
+};
+uniform mat4 model;
+uniform bool instanced;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Must produce bit-identical depth to light_casters.vert, which is then drawn
+// with GL_EQUAL: same inputs, same expression, both invariant.
+invariant gl_Position;
+
+void main() {
+    mat4 modelMatrix = instanced ? aInstanceModel : model;
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    gl_Position = projection * view * modelMatrix * vec4(position, 1.0);
+}
@@ -61,6 +61,15 @@ public:
 	{
 		State = false;
 	}
+	// Held to the right of the camera and pointed where it looks.
+	void Follow(const Camera& camera)
+	{
+		Position = glm::vec3(camera.Position.x - camera.Front.z * 2.0f,
+			camera.Position.y + 1.0f,
+			camera.Position.z + camera.Front.x * 2.0f);
+		Position += camera.Front * 4.0f;
+		Direction = camera.Front;
+	}
 	void SetIntensity(float intensity) {
 		Diffuse = glm::vec3(intensity);
 	}
@@ -4,43 +4,75 @@ out vec4 FragColor;
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#ifndef WORLD_SPACE_LIGHTING
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
-    vec3 TangentLightDir; 
-    vec3 TangentPointLightPos[5]; 
+    vec3 TangentLightDir;
+#endif
+    mat3 TangentToWorld;
 } fs_in;
 
 uniform sampler2D diffuseMap;
 uniform sampler2D specularMap;
 uniform sampler2D normalMap;
 
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    mat4 lightSpaceMatrix;
+    vec3 viewPos;
+};
+
+// Clustered point lights, see LightClusters.h.
+uniform samplerBuffer lightData;        // 3 texels per light
+uniform usamplerBuffer lightGrid;       // per cluster: first index, count
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterCount;
+uniform vec2 clusterTileSize;           // pixels
+uniform float clusterSliceNear;
+uniform float clusterSliceScale;
+
 struct PointLight {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+    vec3 position;
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
 };
 
-struct SpotLight {
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+PointLight fetchPointLight(int index) {
+    vec4 positionQuadratic = texelFetch(lightData, index * 3);
+    vec4 diffuseConstant = texelFetch(lightData, index * 3 + 1);
+    vec4 specularLinear = texelFetch(lightData, index * 3 + 2);
+    return PointLight(positionQuadratic.xyz, diffuseConstant.w, diffuseConstant.xyz, specularLinear.w,
+        specularLinear.xyz, positionQuadratic.w);
+}
+
+int clusterIndex() {
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterTileSize), ivec2(0), clusterCount.xy - 1);
+    float depth = -(view * vec4(fs_in.FragPos, 1.0)).z;
+    int slice = clamp(int(log(max(depth, clusterSliceNear) / clusterSliceNear) * clusterSliceScale), 0, clusterCount.z - 1);
+    return tile.x + clusterCount.x * (tile.y + clusterCount.y * slice);
+}
+
+layout (std140) uniform SpotLight {
+    vec3 position;
     float constant;
+    vec3 direction;
     float linear;
+    vec3 ambient;
     float quadratic;
+    vec3 diffuse;
     float cutOff;
+    vec3 specular;
     float outerCutOff;
     bool state;
-};
-
-uniform PointLight pointLights[5]; 
-uniform SpotLight spotLight;
+} spotLight;
 
 uniform sampler2D shadowMap;
-uniform mat4 lightSpaceMatrix;
 
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir) {
     
@@ -57,67 +89,97 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir) {
     return shadow;
 }
 
-vec3 calculatePointLight(PointLight light, vec3 lightPos, vec3 normal, vec3 fragPos, vec3 viewDir) {
-    vec3 lightDir = normalize(lightPos - fragPos);
+// Compiled in variants (see ShaderVariants.h) picked per draw:
+//   HAS_POINT_LIGHTS   at least one point light is on
+//   HAS_SPOTLIGHT      the flashlight is on
+//   HAS_SHADOW         the flashlight has a shadow map
+//   HAS_NORMAL_MAP     the model has normal maps; otherwise the surface normal is used
+//   HAS_SPECULAR_MAP   the model has specular maps; otherwise there is no specular term
+// and once per run:
+//   WORLD_SPACE_LIGHTING  the spotlight is lit in world space like the point lights,
+//                         instead of in tangent space from per-vertex varyings
+
+vec3 shade(vec3 lightDir, vec3 normal, vec3 viewDir, vec3 albedo, vec3 specularColor, vec3 lightDiffuse, vec3 lightSpecular) {
     float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * texture(diffuseMap, fs_in.TexCoords).rgb * light.diffuse;
-    vec3 reflectDir = reflect(-lightDir, normal);
+    vec3 result = diff * albedo * lightDiffuse;
+#ifdef HAS_SPECULAR_MAP
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
-    vec3 specular = spec * texture(specularMap, fs_in.TexCoords).rgb * light.specular;
-    float distance = length(lightPos - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    diffuse *= attenuation;
-    specular *= attenuation;
-    return (diffuse + specular);
+    result += spec * specularColor * lightSpecular;
+#endif
+    return result;
 }
 
-vec3 calculateSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 lightDir) {
-    float theta = dot(lightDir, normalize(-fs_in.TangentLightDir));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
-
-    float diff = max(dot(normal, lightDir), 0.0);
-    vec3 diffuse = diff * texture(diffuseMap, fs_in.TexCoords).rgb * light.diffuse * intensity;
-
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), 32.0);
-    vec3 specular = spec * texture(specularMap, fs_in.TexCoords).rgb * light.specular * intensity;
-
-    float distance = length(fs_in.TangentLightPos - fragPos);
+vec3 calculatePointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 albedo, vec3 specularColor) {
+    vec3 lightDir = normalize(light.position - fragPos);
+    float distance = length(light.position - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (diffuse + specular);
+    return shade(lightDir, normal, viewDir, albedo, specularColor, light.diffuse, light.specular) * attenuation;
 }
 
-void main() {
-
-    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
-
-    vec3 normal = texture(normalMap, fs_in.TexCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
-
-    vec3 color = texture(diffuseMap, fs_in.TexCoords).rgb;
-    vec3 ambient = 0.01 * color;
-
-    vec3 result = ambient;
-
-    for (int i = 0; i < 5; i++) {
-        result += calculatePointLight(pointLights[i], fs_in.TangentPointLightPos[i], normal, fs_in.TangentFragPos, viewDir);
-    }
-
-    vec3 lightDir = normalize(fs_in.TangentLightPos - fs_in.TangentFragPos);
-    if (spotLight.state == true){
-        vec4 fragPosLightSpace = lightSpaceMatrix * vec4(fs_in.FragPos, 1.0);
+// All vectors in one space, either world or tangent space.
+vec3 calculateSpotLight(vec3 normal, vec3 fragPos, vec3 viewDir, vec3 lightPos, vec3 lightDir, vec3 spotDirection,
+    vec3 albedo, vec3 specularColor) {
+    float theta = dot(lightDir, normalize(-spotDirection));
+    float epsilon = spotLight.cutOff - spotLight.outerCutOff;
+    float intensity = clamp((theta - spotLight.outerCutOff) / epsilon, 0.0, 1.0);
 
-        float shadow = ShadowCalculation(fragPosLightSpace, normal, lightDir);
+    float distance = length(lightPos - fragPos);
+    float attenuation = 1.0 / (spotLight.constant + spotLight.linear * distance + spotLight.quadratic * (distance * distance));
+    return shade(lightDir, normal, viewDir, albedo, specularColor, spotLight.diffuse, spotLight.specular) * (intensity * attenuation);
+}
 
-        vec3 spotLightResult = calculateSpotLight(spotLight, normal, fs_in.TangentFragPos, viewDir, lightDir);
-        result += spotLightResult * (1.0 - shadow);
+void main() {
+    vec3 albedo = texture(diffuseMap, fs_in.TexCoords).rgb;
+#ifdef HAS_SPECULAR_MAP
+    vec3 specularColor = texture(specularMap, fs_in.TexCoords).rgb;
+#else
+    vec3 specularColor = vec3(0.0);
+#endif
+#ifdef HAS_NORMAL_MAP
+    vec3 normal = normalize(texture(normalMap, fs_in.TexCoords).rgb * 2.0 - 1.0);
+#else
+    vec3 normal = vec3(0.0, 0.0, 1.0);
+#endif
+
+    vec3 result = 0.01 * albedo;
+
+#if defined(HAS_POINT_LIGHTS) || defined(WORLD_SPACE_LIGHTING)
+    vec3 worldNormal = normalize(fs_in.TangentToWorld * normal);
+    vec3 worldViewDir = normalize(viewPos - fs_in.FragPos);
+#endif
+
+#ifdef HAS_POINT_LIGHTS
+    uvec2 cluster = texelFetch(lightGrid, clusterIndex()).xy;
+    for (uint i = 0u; i < cluster.y; i++) {
+        PointLight light = fetchPointLight(int(texelFetch(lightIndices, int(cluster.x + i)).r));
+        result += calculatePointLight(light, worldNormal, fs_in.FragPos, worldViewDir, albedo, specularColor);
     }
+#endif
+
+#ifdef HAS_SPOTLIGHT
+#ifdef WORLD_SPACE_LIGHTING
+    vec3 spotNormal = worldNormal;
+    vec3 fragPos = fs_in.FragPos;
+    vec3 viewDir = worldViewDir;
+    vec3 lightPos = spotLight.position;
+    vec3 spotDirection = spotLight.direction;
+#else
+    vec3 spotNormal = normal;
+    vec3 fragPos = fs_in.TangentFragPos;
+    vec3 viewDir = normalize(fs_in.TangentViewPos - fs_in.TangentFragPos);
+    vec3 lightPos = fs_in.TangentLightPos;
+    vec3 spotDirection = fs_in.TangentLightDir;
+#endif
+    vec3 lightDir = normalize(lightPos - fragPos);
+    vec3 spotLightResult = calculateSpotLight(spotNormal, fragPos, viewDir, lightPos, lightDir, spotDirection,
+        albedo, specularColor);
+#ifdef HAS_SHADOW
+    vec4 fragPosLightSpace = lightSpaceMatrix * vec4(fs_in.FragPos, 1.0);
+    spotLightResult *= 1.0 - ShadowCalculation(fragPosLightSpace, spotNormal, lightDir);
+#endif
+    result += spotLightResult;
+#endif
 
     FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -1,48 +1,95 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPos;             // w: tangent handedness, 0 or 1
+layout (location = 1) in vec4 aNormalTangent;   // octahedral normal and tangent
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 7) in mat4 aInstanceModel;
 
+// WORLD_SPACE_LIGHTING lights everything in world space, so only the position,
+// the UV and the TBN are interpolated; otherwise the spotlight is lit in
+// tangent space from per-vertex light, view and fragment positions.
 out VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
+#ifndef WORLD_SPACE_LIGHTING
     vec3 TangentLightPos;
     vec3 TangentViewPos;
     vec3 TangentFragPos;
     vec3 TangentLightDir;
-    vec3 TangentPointLightPos[5];
+#endif
+    mat3 TangentToWorld;
 } vs_out;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    mat4 skyboxView;
+    mat4 lightSpaceMatrix;
+    vec3 viewPos;
+};
+
+layout (std140) uniform SpotLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutOff;
+    vec3 specular;
+    float outerCutOff;
+    bool state;
+} spotLight;
+
 uniform mat4 model;
+uniform bool instanced;
+#ifdef WORLD_SPACE_LIGHTING
+uniform mat3 normalMatrix;      // transpose(inverse(mat3(model))), computed on the CPU
+#endif
+
+// Quantized vertices are stored relative to the model's bounds.
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform vec4 texCoordRange;     // offset in xy, scale in zw
+
+// Drawn with GL_EQUAL after depth_prepass.vert when the pre-pass is on.
+invariant gl_Position;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 spotLightDirection;
-uniform vec3 pointLightPositions[5];
+vec3 octahedralDecode(vec2 e) {
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-v.z, 0.0);
+    v.x += v.x >= 0.0 ? -t : t;
+    v.y += v.y >= 0.0 ? -t : t;
+    return normalize(v);
+}
 
 void main() {
-    vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.TexCoords = aTexCoords;
+    mat4 modelMatrix = instanced ? aInstanceModel : model;
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    vs_out.FragPos = vec3(modelMatrix * vec4(position, 1.0));
+    vs_out.TexCoords = texCoordRange.xy + aTexCoords * texCoordRange.zw;
 
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * aNormal);
+#ifdef WORLD_SPACE_LIGHTING
+    // Instance matrices only rotate and scale uniformly, so their upper 3x3
+    // already transforms normals correctly up to length.
+    mat3 normalTransform = instanced ? mat3(aInstanceModel) : normalMatrix;
+#else
+    mat3 normalTransform = transpose(inverse(mat3(modelMatrix)));
+#endif
+    vec3 T = normalize(normalTransform * octahedralDecode(aNormalTangent.zw));
+    vec3 N = normalize(normalTransform * octahedralDecode(aNormalTangent.xy));
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
-    mat3 TBN = transpose(mat3(T, B, N));
+    vec3 B = cross(N, T) * (aPos.w * 2.0 - 1.0);
+    // Point lights are shaded in world space, where the clustered lights live.
+    vs_out.TangentToWorld = mat3(T, B, N);
 
-    vs_out.TangentLightPos = TBN * lightPos;
+#ifndef WORLD_SPACE_LIGHTING
+    mat3 TBN = transpose(mat3(T, B, N));
+    vs_out.TangentLightPos = TBN * spotLight.position;
     vs_out.TangentViewPos = TBN * viewPos;
     vs_out.TangentFragPos = TBN * vs_out.FragPos;
-    vs_out.TangentLightDir = TBN * spotLightDirection;
-
-    for (int i = 0; i < 5; i++) {
-        vs_out.TangentPointLightPos[i] = TBN * pointLightPositions[i];
-    }
+    vs_out.TangentLightDir = TBN * spotLight.direction;
+#endif
 
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * modelMatrix * vec4(position, 1.0);
 }
\ No newline at end of file
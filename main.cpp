@@ -1,6 +1,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb/stb_image.h>
+#include <stb/stb_image_write.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -14,16 +15,35 @@
 #include "model.h"
 #include "flashlight.h"
 #include "AABB.h"
+#include "CollisionWorld.h"
+#include "BroadphaseBenchmark.h"
+#include "KernelSelfTest.h"
+#include "InteractionIndex.h"
 #include "Player.h"
 #include "Menu.h"
+#include "Simulation.h"
+#include "TripleBuffer.h"
+#include "InputRecording.h"
+#include "HeadlessContext.h"
+#include "FrameProfiler.h"
+#include "FrameUniforms.h"
+#include "InstanceBuffer.h"
+#include "Frustum.h"
+#include "PortalGraph.h"
+#include "OcclusionCuller.h"
+#include "ShadowScheduler.h"
+#include "OverdrawCounter.h"
+#include "LightClusters.h"
+#include "ShaderVariants.h"
 
 #include <iostream>
 #include <vector>
-
-struct ModelInstance {
-    Model& model;
-    glm::mat4 matrix;
-};
+#include <string>
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <random>
+#include <functional>
 
 struct PointLightState {
     glm::vec3 ambient;
@@ -45,21 +65,92 @@ std::vector<Battery> batteries;
 
 Player player;
 
-PointLightState pointLights[5] = {
-    {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false},
-    {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false},
-    {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false},
-    {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false},
-    {glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false},
+// The level's bonfires. Each one has a point light that stays dark until it is lit.
+std::vector<glm::vec3> pointLightPositions = {
+    glm::vec3(-496.0f, 3.0f, -535.0f),
+    glm::vec3(-490.0f, 3.0f, -73.0f),
+    glm::vec3(-488.0f,  3.0f, 383.0f),
+    glm::vec3(458.0f, 3.0f, 370.0f),
+    glm::vec3(505.0f, 3.0f, -347.0f)
 };
 
+std::vector<PointLightState> pointLights(pointLightPositions.size(),
+    PointLightState{ glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 1.0f, 0.0009f, 0.00032f, false });
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void processInput(GLFWwindow* window, std::vector<AABB>& meshesAABB);
-void RenderScene(Shader& shader, Model& model1, const glm::mat4& model1Matrix,
-    Model& ourModel, const std::vector<glm::mat4>& swordMatrices,
-    const std::vector<Battery>& batteries, Model& batteryModel,
-    Model& flashlightModel, const glm::mat4& flashlightMatrix);
+InputState PollInput(GLFWwindow* window);
+void processInput(const InputState& input, const InputState& previous, const CollisionWorld& world, float dt);
+void SimulationTick(const InputState& input, const InputState& previous, float dt, const CollisionWorld& world);
+void PublishSnapshot(double tickTime);
+void RestartGame();
+std::vector<glm::vec3> GetActiveFirePositions();
+// Everything RenderScene draws. The bounds are world-space boxes packed for
+// frustum culling: one per level mesh and one per sword or battery instance.
+struct SceneDraw {
+    Model* level;
+    glm::mat4 levelMatrix;
+    AABBSoA levelBounds;
+
+    Model* flashlight;
+    glm::mat4 flashlightMatrix;
+
+    Model* sword;
+    std::vector<glm::mat4> swordMatrices;
+    AABBSoA swordBounds;
+    InstanceBuffer swordInstances;
+
+    Model* battery;
+    std::vector<glm::mat4> batteryMatrices;     // active batteries only
+    AABBSoA batteryBounds;
+    InstanceBuffer batteryInstances;
+
+    // Cells the current pass can see; null draws everything in the frustum.
+    const PortalGraph* portals = nullptr;
+    // Software depth test against the nearest walls, camera pass only.
+    OcclusionCuller* occlusion = nullptr;
+
+    // Lit pass only: each model is drawn with the variant for lightingFeatures
+    // plus its material maps, and prepareShader runs with the variant's mask
+    // whenever the pass switches to another variant.
+    ShaderVariants* lightingShaders = nullptr;
+    unsigned int lightingFeatures = 0;
+    std::function<void(Shader&, unsigned int)> prepareShader;
+    Shader* currentShader = nullptr;
+
+    // What the last CullScene kept: level mesh indices for RenderScene, while
+    // the surviving prop matrices are already in the instance buffers.
+    std::vector<uint32_t> visibleLevel;
+    size_t visibleLevelCount = 0;
+
+    // Scratch space reused by every cull.
+    std::vector<uint32_t> visible;
+    std::vector<glm::mat4> visibleMatrices;
+};
+
+// What a RenderScene call writes. Depth passes read the position-only
+// vertex streams, bind no textures and mask colour writes.
+enum ScenePass {
+    SCENE_PASS_SHADED,
+    SCENE_PASS_DEPTH,
+    SCENE_PASS_SHADOW   // depth of shadow casters only; the flashlight never shadows its own beam
+};
+
+// Bits of a lighting shader variant, in the order of LIGHTING_DEFINES.
+enum LightingFeature {
+    LIGHTING_POINT_LIGHTS = 1 << 0,
+    LIGHTING_SPOTLIGHT = 1 << 1,
+    LIGHTING_SHADOW = 1 << 2,
+    LIGHTING_NORMAL_MAP = 1 << 3,
+    LIGHTING_SPECULAR_MAP = 1 << 4,
+    LIGHTING_WORLD_SPACE = 1 << 5       // chosen once per run, see --world-lighting
+};
+const std::vector<std::string> LIGHTING_DEFINES = {
+    "HAS_POINT_LIGHTS", "HAS_SPOTLIGHT", "HAS_SHADOW", "HAS_NORMAL_MAP", "HAS_SPECULAR_MAP", "WORLD_SPACE_LIGHTING"
+};
+
+void CullScene(SceneDraw& scene, const Frustum& frustum);
+void RenderScene(Shader& shader, SceneDraw& scene, const Frustum& frustum, const glm::vec3& eye, ScenePass pass);
 unsigned int loadTexture(const char* path);
 unsigned int loadCubemap(vector<std::string> faces);
 
@@ -76,98 +167,177 @@ Camera camera(glm::vec3(-546.0f, 7.0f, 628.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
+double mouseTotalX = 0.0;
+double mouseTotalY = 0.0;
 
 Flashlight flashlight;
-bool fKeyPressedLastFrame = false;
 
-bool eKeyPressedLastFrame = false;
-const float LIGHT_ACTIVATION_DISTANCE = 10.0f;
+const float LIGHT_ACTIVATION_DISTANCE = 9.0f;
 const float LIGHT_ACTIVATION_ANGLE = 15.0f;
 
+// Roughly one corridor wide. Walls are sampled in a band around eye height.
+const float PORTAL_CELL_SIZE = 8.0f;
+const float PORTAL_EYE_MIN_Y = 6.0f;
+const float PORTAL_EYE_MAX_Y = 8.0f;
+// Wall triangles smaller than this never hide enough to be worth rasterizing.
+const float OCCLUDER_MIN_AREA = 1.0f;
+// While the flashlight moves less than this since the last shadow render, the
+// map is redrawn at most every SHADOW_REUSE_FRAMES + 1 frames.
+const int SHADOW_REUSE_FRAMES = 3;
+const float SHADOW_REUSE_DISTANCE = 0.5f;
+const float SHADOW_REUSE_ANGLE = 1.0f;
+
+InteractionIndex interactions;
+
+float simulationRate = 120.0f;
+float simulationTime = 0.0f;
+
+// Everything the renderer reads from the simulation, copied once per tick.
+struct FrameSnapshot {
+    Camera camera;
+    Flashlight flashlight;
+    std::vector<PointLightState> pointLights;
+    std::vector<bool> batteryActive;
+    double tickTime = 0.0;
+};
 
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+TripleBuffer<FrameSnapshot> snapshots;
+void FillSnapshot(FrameSnapshot& snapshot, double tickTime);
+std::atomic<bool> restartRequested{ false };
+std::atomic<bool> replayFinished{ false };
+
+enum RenderPass {
+    PASS_SHADOW,
+    PASS_DEPTH_PREPASS,
+    PASS_SCENE,
+    PASS_LIGHT_CUBES,
+    PASS_SKYBOX
+};
 
 
 SoundManager soundManager;
 bool isWalking = false;
 bool isJumping = false;
 
-int main()
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 4);
+    std::string recordPath, replayPath;
+    bool headlessMode = false;
+    int benchmarkFrames = 600;
+    int shadowReuseFrames = SHADOW_REUSE_FRAMES;
+    bool depthPrepass = false;
+    bool worldSpaceLighting = false;
+    int benchmarkLights = 0;
+    std::vector<int> dumpFrames;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench-broadphase") {
+            BroadphaseBenchmark::Run();
+            return 0;
+        }
+        if (std::string(argv[i]) == "--self-test") {
+            return KernelSelfTest::Run() ? 0 : 1;
+        }
+        if (std::string(argv[i]) == "--tick-rate" && i + 1 < argc) {
+            simulationRate = std::max(1.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        if (std::string(argv[i]) == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        }
+        if (std::string(argv[i]) == "--headless") {
+            headlessMode = true;
+        }
+        if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+            benchmarkFrames = std::max(1, std::atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--bench-lights" && i + 1 < argc) {
+            // Extra small lights scattered over the level, headless runs only
+            benchmarkLights = std::max(0, std::atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--z-prepass") {
+            depthPrepass = true;
+        }
+        if (std::string(argv[i]) == "--world-lighting") {
+            // Light in world space with a CPU normal matrix and fewer varyings
+            worldSpaceLighting = true;
+        }
+        if (std::string(argv[i]) == "--shadow-reuse" && i + 1 < argc) {
+            // 0 redraws the shadow map on every change
+            shadowReuseFrames = std::max(0, std::atoi(argv[++i]));
+        }
+        if (std::string(argv[i]) == "--dump-frames" && i + 1 < argc) {
+            // Comma separated frame numbers, e.g. 0,300,599
+            std::string list = argv[++i];
+            for (size_t start = 0; start < list.size();) {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                dumpFrames.push_back(std::atoi(list.substr(start, end - start).c_str()));
+                start = end + 1;
+            }
+        }
+    }
+
+    // A replay must run at the recorded tick rate with the recorded random seed to follow the same route.
+    InputRecorder recorder;
+    InputReplay replay;
+    uint32_t seed = std::random_device()();
+    if (!replayPath.empty()) {
+        if (!replay.Load(replayPath)) {
+            std::cerr << "Failed to load input recording: " << replayPath << std::endl;
+            return -1;
+        }
+        simulationRate = replay.GetTickRate();
+        seed = replay.GetSeed();
+    }
+    player.Seed(seed);
+
+    // Headless runs render into an offscreen framebuffer and never open a window.
+    GLFWwindow* window = nullptr;
+    HeadlessContext headless;
+    if (headlessMode) {
+        if (!headless.Create(SCR_WIDTH, SCR_HEIGHT))
+            return -1;
+    }
+    else {
+        // glfw: initialize and configure
+        // ------------------------------
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_SAMPLES, 4);
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Maze", glfwGetPrimaryMonitor(), nullptr);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Maze", glfwGetPrimaryMonitor(), nullptr);
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-    {
-        std::cout << "Failed to initialize GLAD" << std::endl;
-        return -1;
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
     }
 
     Menu menu(window);
     menu.AddButton("Restart", glm::vec2(SCR_WIDTH / 2 - 100, SCR_HEIGHT / 2 - 50), glm::vec2(200, 50), [&]() {
         //  
-        camera.SetPosition(glm::vec3(-546.0f, 7.0f, 628.0f));
-        flashlight.BatteryLevel = 100.0f;
-
-        for (int i = 0; i < 5; i++) {
-            if (pointLights[i].isOn) {
-                pointLights[i].isOn = false;
-                pointLights[i].diffuse = glm::vec3(0.0f);
-                pointLights[i].ambient = glm::vec3(0.0f);
-                pointLights[i].specular = glm::vec3(0.0f);
-
-                soundManager.stopAllFireSounds();
-            }
-        }
-
-        for (auto& battery : batteries) {
-            battery.isActive = true;
-            //       
-            if (battery.matrices.empty()) {
-                glm::mat4 model = glm::mat4(1.0f);
-                model = glm::translate(model, battery.position);
-                model = glm::scale(model, glm::vec3(7.0f));
-                battery.matrices.push_back(model);
-
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, battery.position + glm::vec3(0.2f, 0.0f, -0.2f));
-                model = glm::scale(model, glm::vec3(7.0f));
-                battery.matrices.push_back(model);
-
-                model = glm::mat4(1.0f);
-                model = glm::translate(model, battery.position + glm::vec3(-0.2f, 0.0f, 0.2f));
-                model = glm::scale(model, glm::vec3(7.0f));
-                battery.matrices.push_back(model);
-            }
-        }
-
-        player.Reset();
+        restartRequested = true;
 
         menu.Toggle();
         });
@@ -180,16 +350,32 @@ int main()
     glEnable(GL_DEPTH_TEST);
 
 
-    if (!soundManager.loadSounds()) {
+    if (!headlessMode && !soundManager.loadSounds()) {
         std::cerr << "Failed to load sounds!" << std::endl;
         return -1;
     }
 
 
-    Shader lightingShader("light_casters.vert", "light_casters.frag");
+    // One lighting program per combination of active lights and material maps,
+    // so no fragment pays for a light or texture it does not have.
+    std::vector<LightClusters::Uniforms> clusterUniforms(size_t(1) << LIGHTING_DEFINES.size());
+    ShaderVariants lightingShaders("light_casters.vert", "light_casters.frag", LIGHTING_DEFINES,
+        [&clusterUniforms](Shader& shader, unsigned int features) {
+        shader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        shader.bindUniformBlock("SpotLight", SPOT_LIGHT_BINDING);
+        shader.setInt("diffuseMap", DIFFUSE_MAP_UNIT);
+        shader.setInt("specularMap", SPECULAR_MAP_UNIT);
+        shader.setInt("normalMap", NORMAL_MAP_UNIT);
+        shader.setInt("shadowMap", 3);
+        shader.setInt("lightData", LIGHT_DATA_UNIT);
+        shader.setInt("lightGrid", LIGHT_GRID_UNIT);
+        shader.setInt("lightIndices", LIGHT_INDEX_UNIT);
+        clusterUniforms[features] = LightClusters::Resolve(shader);
+    });
     Shader lightCubeShader("light_cube.vert", "light_cube.frag");
     Shader skyboxShader("skybox.vert", "skybox.frag");
 	Shader shadowDepthShader("default.vert", "default.frag");
+    Shader depthPrepassShader("depth_prepass.vert", "default.frag");
 
 	Model model1("models/labirynth5.obj");
     Model ourModel("models/swordfornekit.obj");
@@ -339,13 +525,6 @@ int main()
          1.0f, -1.0f,  1.0f
     };
 
-    glm::vec3 pointLightPositions[] = {
-        glm::vec3(-496.0f, 3.0f, -535.0f),
-        glm::vec3(-490.0f, 3.0f, -73.0f),
-        glm::vec3(-488.0f,  3.0f, 383.0f),
-        glm::vec3(458.0f, 3.0f, 370.0f),
-        glm::vec3(505.0f, 3.0f, -347.0f)
-    };
 
     unsigned int VBO, cubeVAO;
     glGenVertexArrays(1, &cubeVAO);
@@ -416,10 +595,13 @@ int main()
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    lightingShader.use();
-    lightingShader.setInt("diffuseMap", 0);
-	lightingShader.setInt("specularMap", 1);
-	lightingShader.setInt("normalMap", 2);
+    // Compile every variant a frame can select before the first frame rather
+    // than mid-game. The flashlight is the only shadow caster and always has a
+    // map while on, so the spotlight and shadow bits are set together.
+    unsigned int lightingPath = worldSpaceLighting ? LIGHTING_WORLD_SPACE : 0;
+    lightingShaders.Warm(lightingPath, LIGHTING_WORLD_SPACE - 1, [](unsigned int features) {
+        return ((features & LIGHTING_SPOTLIGHT) != 0) == ((features & LIGHTING_SHADOW) != 0);
+    });
 
     vector<std::string> faces
     {
@@ -436,309 +618,430 @@ int main()
     skyboxShader.setInt("skybox", 0);
     skyboxShader.setBool("ActiveCubeMap", false);
 
+    // Camera and light data is shared by all programs through uniform blocks
+    // that are filled once per frame.
+    for (const Shader* shader : { &lightCubeShader, &skyboxShader, &shadowDepthShader, &depthPrepassShader }) {
+        shader->bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+        shader->bindUniformBlock("SpotLight", SPOT_LIGHT_BINDING);
+    }
+    FrameUniforms frameUniforms;
+    frameUniforms.Create();
+    Shader::Uniform skyboxActive = skyboxShader.getUniform("ActiveCubeMap");
+
+    // Level geometry is static, so the collision hierarchy is built once here.
+    // The capsule controller sweeps against the triangles only.
+    CollisionWorld collisionWorld;
+
+    glm::mat4 model1CollisionMatrix = glm::mat4(1.0f);
+    model1CollisionMatrix = glm::translate(model1CollisionMatrix, glm::vec3(0.0f, -25.0f, 0.0f));
+    model1CollisionMatrix = glm::scale(model1CollisionMatrix, glm::vec3(300.0f, 150.0f, 300.0f));
+    std::vector<glm::vec3> levelTriangles = model1.GetTriangles(model1CollisionMatrix);
+    collisionWorld.AddTriangles(levelTriangles);
+    for (const auto& matrix : swordMatrices) {
+        collisionWorld.AddTriangles(ourModel.GetTriangles(matrix));
+    }
 
-    while (!glfwWindowShouldClose(window))
-    {
-
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    collisionWorld.Build();
 
-        std::vector<AABB> allAABB;
+    PortalGraph portals;
+    portals.Build(levelTriangles, Transform(model1.GetAABB(), model1CollisionMatrix), PORTAL_CELL_SIZE, PORTAL_EYE_MIN_Y, PORTAL_EYE_MAX_Y);
+    std::cout << "Portal graph: " << portals.GetCellCount() << " cells, " << portals.GetPortalCount() << " portals" << std::endl;
 
-        auto model1AABB = model1.GetMeshesAABB(glm::vec3(300.0f, 150.0f, 300.0f), glm::vec3(0.0f, -25.0f, 0.0f));
-        allAABB.insert(allAABB.end(), model1AABB.begin(), model1AABB.end());
+    OcclusionCuller occlusion;
+    occlusion.SetOccluders(levelTriangles, OCCLUDER_MIN_AREA);
+    occlusion.Start(std::max(1u, std::thread::hardware_concurrency() / 2));
 
-        for (const auto& matrix : swordMatrices) {
-            auto swordAABB = ourModel.GetMeshesAABB(glm::vec3(2.0f), glm::vec3(0.0f, 3.0f, 0.0f));
-            for (auto& box : swordAABB) {
-                box.min = glm::vec3(matrix * glm::vec4(box.min, 1.0f));
-                box.max = glm::vec3(matrix * glm::vec4(box.max, 1.0f));
-                allAABB.push_back(box);
-            }
-        }
 
-        for (const auto& matrix : batteryMatrices) {
-            auto batteryAABB = ourModel.GetMeshesAABB(glm::vec3(2.0f), glm::vec3(0.0f, 3.0f, 0.0f));
-            for (auto& box : batteryAABB) {
-                box.min = glm::vec3(matrix * glm::vec4(box.min, 1.0f));
-                box.max = glm::vec3(matrix * glm::vec4(box.max, 1.0f));
-                allAABB.push_back(box);
-            }
+    for (size_t i = 0; i < pointLightPositions.size(); i++) {
+        interactions.Add(pointLightPositions[i], LIGHT_ACTIVATION_DISTANCE, INTERACTION_BONFIRE, static_cast<int>(i));
+    }
+    for (size_t i = 0; i < batteries.size(); i++) {
+        interactions.Add(batteries[i].position, LIGHT_ACTIVATION_DISTANCE, INTERACTION_BATTERY, static_cast<int>(i));
+    }
+    interactions.Build();
+
+    // Batteries are drawn from this copy; only their visibility comes from the snapshot.
+    std::vector<Battery> batteryDraws = batteries;
+    std::vector<bool> uploadedBatteryActive;
+    // Bumped whenever something that casts a flashlight shadow appears or disappears.
+    unsigned int shadowCasterVersion = 0;
+
+    ShadowScheduler shadows;
+    shadows.maxReuseFrames = shadowReuseFrames;
+    shadows.reuseDistance = SHADOW_REUSE_DISTANCE;
+    shadows.reuseAngle = SHADOW_REUSE_ANGLE;
+
+    SceneDraw scene;
+    scene.level = &model1;
+    scene.levelMatrix = model1CollisionMatrix;
+    model1.GetMeshBounds(scene.levelMatrix, scene.levelBounds);
+    scene.flashlight = &flashlightModel;
+    scene.sword = &ourModel;
+    scene.swordMatrices = swordMatrices;
+    for (const auto& matrix : swordMatrices)
+        scene.swordBounds.Add(Transform(ourModel.GetAABB(), matrix));
+    scene.swordInstances.Create();
+    scene.battery = &batteryModel;
+    scene.batteryInstances.Create();
+    scene.portals = &portals;
+
+    // Bonfires first, then any benchmark lights; rebinned into clusters every frame.
+    LightClusters lightClusters;
+    lightClusters.Create();
+    std::vector<ClusterLight> frameLights;
+    std::vector<ClusterLight> extraLights;
+    if (headlessMode && benchmarkLights > 0) {
+        AABB levelBox = Transform(model1.GetAABB(), model1CollisionMatrix);
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> along(0.0f, 1.0f);
+        for (int i = 0; i < benchmarkLights; i++) {
+            ClusterLight light;
+            light.position = glm::vec3(glm::mix(levelBox.min.x, levelBox.max.x, along(random)), 3.0f,
+                glm::mix(levelBox.min.z, levelBox.max.z, along(random)));
+            light.diffuse = light.specular = glm::vec3(1.0f, 0.35f, 0.0f);
+            light.constant = 1.0f;
+            light.linear = 0.09f;
+            light.quadratic = 0.032f;
+            extraLights.push_back(light);
         }
+    }
 
-        processInput(window, allAABB);
-        camera.UpdatePhysics(deltaTime, soundManager);
-
-        static bool escPressedLastFrame = false;
-
-        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS && !escPressedLastFrame) {
-            menu.Toggle();
-            escPressedLastFrame = true;
-        }
-        else if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_RELEASE) {
-            escPressedLastFrame = false;
-        }
+    InstanceBuffer lightCubeInstances;
 
-        if (menu.IsActive()) {
-            menu.ProcessInput();
-            menu.Render();
-            glfwSwapBuffers(window);
-            glfwPollEvents();
-            continue;
+    std::vector<glm::mat4> lightCubeMatrices;
+    for (const glm::vec3& position : pointLightPositions) {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, position);
+        model = glm::scale(model, glm::vec3(0.05f));
+        lightCubeMatrices.push_back(model);
+    }
+    lightCubeInstances.Create();
+    lightCubeInstances.Upload(lightCubeMatrices);
+    lightCubeInstances.AttachTo(lightCubeVAO);
+
+    // Draws the scene as seen from a snapshot into targetFramebuffer. alpha places
+    // the camera between the snapshot's last two ticks.
+    auto renderFrame = [&](const FrameSnapshot& frame, float alpha, unsigned int targetFramebuffer, FrameProfiler* profiler,
+        OverdrawCounter* overdraw) {
+        for (size_t i = 0; i < batteryDraws.size(); i++) {
+            batteryDraws[i].isActive = frame.batteryActive[i];
         }
-
-        bool eKeyPressedLastFrame = false;
-        const float LIGHT_ACTIVATION_DISTANCE = 9.0f;
-        const float LIGHT_ACTIVATION_ANGLE = 15.0f;
-
-        if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS && !eKeyPressedLastFrame) {
-            for (int i = 0; i < 5; i++) {
-                float distanceLight = glm::distance(camera.Position, pointLightPositions[i]);
-                if (distanceLight <= LIGHT_ACTIVATION_DISTANCE &&
-                    camera.IsLookingAt(pointLightPositions[i], LIGHT_ACTIVATION_ANGLE) && pointLights[i].isOn == false) {
-
-                    pointLights[i].isOn = true;
-                    player.RegisterFireActivation();
-                    soundManager.playSound(SoundManager::BORNFIRE, 80.0f);
-                    soundManager.playFireSound(pointLightPositions[i], 20.0f, true);
-                    glm::vec3 newDiffuse = pointLights[i].isOn ? glm::vec3(1.0f, 0.35f, 0.0f) : glm::vec3(0.0f);
-
-					pointLights[i].diffuse = newDiffuse;
-                    pointLights[i].ambient = newDiffuse;
-                    pointLights[i].specular = newDiffuse;
-
+        // The battery instance list only changes when one is picked up or the game restarts.
+        if (uploadedBatteryActive != frame.batteryActive) {
+            scene.batteryMatrices.clear();
+            scene.batteryBounds.Clear();
+            for (const auto& battery : batteryDraws) {
+                if (!battery.isActive)
+                    continue;
+                for (const auto& matrix : battery.matrices) {
+                    scene.batteryMatrices.push_back(matrix);
+                    scene.batteryBounds.Add(Transform(batteryModel.GetAABB(), matrix));
                 }
             }
-
-            for (auto& battery : batteries) {
-                if (battery.isActive) {
-                    float distance = glm::distance(camera.Position, battery.position);
-                    if (distance <= LIGHT_ACTIVATION_DISTANCE &&
-                        camera.IsLookingAt(battery.position, LIGHT_ACTIVATION_ANGLE))
-                    {
-                        soundManager.playSound(SoundManager::BATTERY, 80.0f);
-                        flashlight.Charge();
-                        battery.isActive = false;
-                        battery.matrices.clear();
-                        break;
-                    }
-                }
-            }
-
-            eKeyPressedLastFrame = true;
+            uploadedBatteryActive = frame.batteryActive;
+            shadowCasterVersion++;
         }
+        size_t activeFireCount = 0;
+        for (const PointLightState& light : frame.pointLights) {
+            if (light.isOn) activeFireCount++;
+        }
+
+        // Everything attached to the camera is drawn at the interpolated camera position.
+        glm::vec3 renderPosition = frame.camera.GetInterpolatedPosition(alpha);
+        glm::vec3 renderOffset = renderPosition - frame.camera.Position;
+        glm::vec3 flashlightRenderPosition = frame.flashlight.Position + renderOffset;
 
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
         float near_plane = 4.0f, far_plane = 2000.0f;
         glm::mat4 lightProjection = glm::perspective(glm::radians(90.0f), (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT, near_plane, far_plane);
-        glm::mat4 lightView = glm::lookAt(flashlight.Position, flashlight.Position + flashlight.Direction, glm::vec3(0.0f, 1.0f, 0.0f));
-        glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-
-        shadowDepthShader.use();
-        shadowDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-        glm::mat4 model1Matrix = glm::mat4(1.0f);
-        model1Matrix = glm::translate(model1Matrix, glm::vec3(0.0f, -25.0f, 0.0f));
-        model1Matrix = glm::scale(model1Matrix, glm::vec3(300.0f, 150.0f, 300.0f));
-        lightingShader.setMat4("model", model1Matrix);
+        glm::mat4 lightView = glm::lookAt(flashlightRenderPosition, flashlightRenderPosition + frame.flashlight.Direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        float cameraFar = 1000.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(frame.camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, cameraFar);
+        glm::mat4 view = frame.camera.GetViewMatrix(renderPosition);
+
+        // Occluders are rasterized on the workers while the shadow pass is submitted.
+        occlusion.Begin(renderPosition, projection * view);
+
+        ShadowUpdate shadowUpdate = shadows.Update(frame.flashlight.State, lightProjection * lightView,
+            flashlightRenderPosition, frame.flashlight.Direction, shadowCasterVersion);
+
+        FrameData& frameData = frameUniforms.frame;
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.skyboxView = glm::mat4(glm::mat3(view));
+        frameData.lightSpaceMatrix = shadows.GetLightSpaceMatrix();
+        frameData.viewPos = renderPosition;
+        frameLights.clear();
+        for (size_t i = 0; i < frame.pointLights.size(); i++) {
+            ClusterLight light;
+            light.position = pointLightPositions[i];
+            light.diffuse = frame.pointLights[i].diffuse;
+            light.specular = frame.pointLights[i].specular;
+            light.constant = frame.pointLights[i].constant;
+            light.linear = frame.pointLights[i].linear;
+            light.quadratic = frame.pointLights[i].quadratic;
+            frameLights.push_back(light);
+        }
+        frameLights.insert(frameLights.end(), extraLights.begin(), extraLights.end());
+        lightClusters.Build(frameLights, view, projection, cameraFar, (float)SCR_WIDTH, (float)SCR_HEIGHT);
+        SpotLightData& spotLight = frameUniforms.spotLight;
+        spotLight.position = flashlightRenderPosition;
+        spotLight.direction = frame.flashlight.Direction;
+        spotLight.ambient = frame.flashlight.Ambient;
+        spotLight.diffuse = frame.flashlight.Diffuse;
+        spotLight.specular = frame.flashlight.Specular;
+        spotLight.constant = frame.flashlight.Constant;
+        spotLight.linear = frame.flashlight.Linear;
+        spotLight.quadratic = frame.flashlight.Quadratic;
+        spotLight.cutOff = glm::cos(glm::radians(frame.flashlight.CutOff));
+        spotLight.outerCutOff = glm::cos(glm::radians(frame.flashlight.OuterCutOff));
+        spotLight.state = frame.flashlight.State ? 1 : 0;
+        frameUniforms.Upload();
 
         glm::mat4 flashlightMatrix = glm::mat4(1.0f);
-        flashlightMatrix = glm::translate(flashlightMatrix, flashlight.Position);
-        flashlightMatrix = glm::rotate(flashlightMatrix, glm::radians(-camera.Yaw + 90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        flashlightMatrix = glm::rotate(flashlightMatrix, glm::radians(-camera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f));
+        flashlightMatrix = glm::translate(flashlightMatrix, flashlightRenderPosition);
+        flashlightMatrix = glm::rotate(flashlightMatrix, glm::radians(-frame.camera.Yaw + 90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        flashlightMatrix = glm::rotate(flashlightMatrix, glm::radians(-frame.camera.Pitch), glm::vec3(1.0f, 0.0f, 0.0f));
 
         flashlightMatrix = glm::rotate(flashlightMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
         flashlightMatrix = glm::scale(flashlightMatrix, glm::vec3(8.0f));
+        scene.flashlightMatrix = flashlightMatrix;
+
+        if (profiler) profiler->BeginPass(PASS_SHADOW);
+        if (shadowUpdate == SHADOW_RENDER) {
+            glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+            glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            shadowDepthShader.use();
+
+            // The shadow pass only needs what the flashlight can see.
+            portals.FindVisibleCells(flashlightRenderPosition, frameData.lightSpaceMatrix);
+            Frustum lightFrustum(frameData.lightSpaceMatrix);
+            CullScene(scene, lightFrustum);
+            RenderScene(shadowDepthShader, scene, lightFrustum, flashlightRenderPosition, SCENE_PASS_SHADOW);
+        }
+        if (profiler) profiler->EndPass();
 
-        lightingShader.setMat4("model", flashlightMatrix);
-
-        std::vector<ModelInstance> models = {
-            {model1, model1Matrix}
-        };
-
-        RenderScene(
-            shadowDepthShader,
-            model1,
-            model1Matrix,
-            ourModel,
-            swordMatrices,
-            batteries,
-            batteryModel,
-            flashlightModel,
-            flashlightMatrix
-        );
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
         glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        lightingShader.use();
-        lightingShader.setVec3("viewPos", camera.Position);
-        lightingShader.setFloat("material.shininess", 32.0f);
+        portals.FindVisibleCells(renderPosition, projection * view);
+        occlusion.Wait();
+        // One cull serves both the depth pre-pass and the lit pass.
+        Frustum cameraFrustum(projection * view);
+        scene.occlusion = &occlusion;
+        CullScene(scene, cameraFrustum);
+        scene.occlusion = nullptr;
+
+        // Lays down the final depth first, so the lighting shader runs once per
+        // pixel instead of once per overlapping wall.
+        if (depthPrepass) {
+            if (profiler) profiler->BeginPass(PASS_DEPTH_PREPASS);
+            if (overdraw) overdraw->Begin(OverdrawCounter::WITHOUT_PREPASS);
+            depthPrepassShader.use();
+            RenderScene(depthPrepassShader, scene, cameraFrustum, renderPosition, SCENE_PASS_DEPTH);
+            if (overdraw) overdraw->End();
+            if (profiler) profiler->EndPass();
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
 
-        lightingShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        if (profiler) profiler->BeginPass(PASS_SCENE);
+        if (overdraw) overdraw->Begin(depthPrepass ? OverdrawCounter::WITH_PREPASS : OverdrawCounter::WITHOUT_PREPASS);
         glActiveTexture(GL_TEXTURE3);
         glBindTexture(GL_TEXTURE_2D, depthMap);
-        lightingShader.setInt("shadowMap", 3);
-
-        lightingShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        lightingShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.05f);
-        lightingShader.setVec3("dirLight.diffuse", 0.4f, 0.4f, 0.4f);
-        lightingShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-        for (int i = 0; i < 5; i++) {
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].diffuse", pointLights[i].diffuse);
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].position", pointLightPositions[i]);
-            lightingShader.setVec3("pointLightPositions[" + std::to_string(i) + "]", pointLightPositions[i]);
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].ambient", pointLights[i].ambient);
-            lightingShader.setVec3("pointLights[" + std::to_string(i) + "].specular", pointLights[i].specular);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].constant", pointLights[i].constant);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].linear", pointLights[i].linear);
-            lightingShader.setFloat("pointLights[" + std::to_string(i) + "].quadratic", pointLights[i].quadratic);
-        }
-        lightingShader.setVec3("spotLight.position", flashlight.Position);
-        lightingShader.setVec3("spotLight.direction", flashlight.Direction);
-        lightingShader.setVec3("spotLightDirection", flashlight.Direction);
-        lightingShader.setVec3("lightPos", flashlight.Position);
-        lightingShader.setVec3("spotLight.ambient", flashlight.Ambient);
-        lightingShader.setVec3("spotLight.diffuse", flashlight.Diffuse);
-        lightingShader.setVec3("spotLight.specular", flashlight.Specular);
-        lightingShader.setFloat("spotLight.constant", flashlight.Constant);
-        lightingShader.setFloat("spotLight.linear", flashlight.Linear);
-        lightingShader.setFloat("spotLight.quadratic", flashlight.Quadratic);
-        lightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(flashlight.CutOff)));
-        lightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(flashlight.OuterCutOff)));
-		lightingShader.setBool("spotLight.state", flashlight.State);
-
-        if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS && !fKeyPressedLastFrame) {
-            if (flashlight.State) {
-                flashlight.TurnOff();
-                soundManager.playSound(SoundManager::FLASHLIGHT, 80.0f);
-            }
-            else {
-                flashlight.TurnOn();
-                soundManager.playSound(SoundManager::FLASHLIGHT, 80.0f);
-            }
-            fKeyPressedLastFrame = true;
-        }
-        else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE) {
-            fKeyPressedLastFrame = false;
-        }
+        glActiveTexture(GL_TEXTURE0);
 
-        soundManager.setListenerPosition(camera.Position.x, camera.Position.y, camera.Position.z);
-        soundManager.setListenerDirection(camera.Front.x, camera.Front.y, camera.Front.z);
+        glBindVertexArray(modelVAO);
 
-        soundManager.updateSoundPosition(SoundManager::WALK,
-            camera.Position.x,
-            camera.Position.y - 1.0f,
-            camera.Position.z);
+        scene.lightingShaders = &lightingShaders;
+        scene.lightingFeatures = lightingPath;
+        if (lightClusters.GetActiveLightCount() > 0)
+            scene.lightingFeatures |= LIGHTING_POINT_LIGHTS;
+        if (frame.flashlight.State)
+            scene.lightingFeatures |= LIGHTING_SPOTLIGHT | LIGHTING_SHADOW;
+        scene.prepareShader = [&](Shader& shader, unsigned int features) {
+            lightClusters.Bind(shader, clusterUniforms[features]);
+        };
+        Shader& lightingShader = lightingShaders.Get(scene.lightingFeatures);
+        RenderScene(lightingShader, scene, cameraFrustum, renderPosition, SCENE_PASS_SHADED);
+        scene.lightingShaders = nullptr;
+        if (overdraw) overdraw->End();
+        if (depthPrepass) {
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+        if (profiler) profiler->EndPass();
 
-        soundManager.updateSoundPosition(SoundManager::JUMP,
-            camera.Position.x,
-            camera.Position.y - 1.0f,
-            camera.Position.z);
+        if (profiler) profiler->BeginPass(PASS_LIGHT_CUBES);
+        lightCubeShader.use();
 
-        std::vector<glm::vec3> activeFirePositions;
-        for (int i = 0; i < 5; i++) {
-            if (pointLights[i].isOn) {
-                activeFirePositions.push_back(pointLightPositions[i]);
-            }
-        }
 
-        soundManager.updateFireSoundPositions(activeFirePositions);
+        
+        glBindVertexArray(lightCubeVAO);
+        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, lightCubeInstances.count);
+        if (profiler) profiler->EndPass();
 
-        player.Update(deltaTime, flashlight, camera, activeFirePositions);
+        if (profiler) profiler->BeginPass(PASS_SKYBOX);
+        glDepthFunc(GL_LEQUAL);
+        skyboxShader.use();
+        if (activeFireCount == pointLightPositions.size()) {
+            skyboxShader.setBool(skyboxActive, true);
+        }
+        glBindVertexArray(skyboxVAO);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LESS);
+        if (profiler) profiler->EndPass();
+    };
 
-        if (player.sleepState == Player::SLEEP) {
-            float intensity = (sin(glfwGetTime() * 10.0f) * 0.5f + 0.5f) * 0.3f + 0.2f;
-            flashlight.Diffuse = glm::vec3(intensity);
+    if (headlessMode) {
+        // Benchmark: fly a fixed route from the spawn point past every bonfire and
+        // back, one step per frame, without running the simulation.
+        std::vector<glm::vec3> route = { camera.Position };
+        for (const auto& position : pointLightPositions) {
+            route.push_back(position + glm::vec3(3.0f, 4.0f, 0.0f));
         }
-        else if (flashlight.State) {
-            flashlight.Diffuse = glm::vec3(1.0f);
+        route.push_back(camera.Position);
+        std::vector<float> distances = { 0.0f };
+        for (size_t i = 1; i < route.size(); i++) {
+            distances.push_back(distances.back() + glm::distance(route[i - 1], route[i]));
         }
 
-        player.HandleHKeyPress(window, flashlight, camera, activeFirePositions);
-
-        bool currentlyWalking = camera.IsMoving();
-        if (currentlyWalking != isWalking) {
-            isWalking = currentlyWalking;
-            if (isWalking) {
-                soundManager.playSound(SoundManager::WALK, 70.0f, true);
-            }
-            else {
-                soundManager.stopSound(SoundManager::WALK);
+        flashlight.TurnOn();
+        FrameSnapshot scripted;
+        FrameProfiler profiler({ "shadow", "depth prepass", "scene", "light cubes", "skybox" });
+        OverdrawCounter overdraw(SCR_WIDTH * SCR_HEIGHT);
+        std::vector<unsigned char> pixels(SCR_WIDTH * SCR_HEIGHT * 3);
+        size_t occludedTotal = 0, occludedMax = 0;
+        size_t clusterLightTotal = 0, clusterLightMax = 0;
+        stbi_flip_vertically_on_write(1);
+
+        for (int f = 0; f < benchmarkFrames; f++) {
+            float travelled = distances.back() * f / benchmarkFrames;
+            size_t leg = 1;
+            while (leg + 1 < route.size() && distances[leg] < travelled) leg++;
+            float t = (travelled - distances[leg - 1]) / std::max(distances[leg] - distances[leg - 1], 0.001f);
+            glm::vec3 direction = route[leg] - route[leg - 1];
+
+            camera.SetPosition(glm::mix(route[leg - 1], route[leg], t));
+            camera.SetOrientation(glm::degrees(std::atan2(direction.z, direction.x)), 0.0f);
+            flashlight.Follow(camera);
+            FillSnapshot(scripted, 0.0);
+
+            double frameStart = Simulation::Now();
+            renderFrame(scripted, 1.0f, headless.framebuffer, &profiler, &overdraw);
+            glFinish();
+            profiler.EndFrame((Simulation::Now() - frameStart) * 1000.0);
+            overdraw.EndFrame();
+            occludedTotal += occlusion.GetCulledCount();
+            occludedMax = std::max(occludedMax, occlusion.GetCulledCount());
+            clusterLightTotal += lightClusters.GetAssignedCount();
+            clusterLightMax = std::max(clusterLightMax, lightClusters.GetMaxLightsPerCluster());
+
+            if (std::find(dumpFrames.begin(), dumpFrames.end(), f) != dumpFrames.end()) {
+                headless.ReadPixels(pixels.data());
+                std::string path = "frame_" + std::to_string(f) + ".png";
+                if (!stbi_write_png(path.c_str(), SCR_WIDTH, SCR_HEIGHT, 3, pixels.data(), SCR_WIDTH * 3))
+                    std::cout << "Failed to write " << path << std::endl;
             }
         }
 
-        bool currentJumping = camera.IsJumping;
+        std::cout << benchmarkFrames << " frames at " << SCR_WIDTH << "x" << SCR_HEIGHT << std::endl;
+        profiler.Print();
+        overdraw.Print();
+        std::cout << "Occlusion culled " << (benchmarkFrames > 0 ? occludedTotal / benchmarkFrames : 0) << " objects per frame on average, "
+            << occludedMax << " at most" << std::endl;
+        std::cout << frameLights.size() << " point lights, " << (benchmarkFrames > 0 ? clusterLightTotal / benchmarkFrames : 0)
+            << " cluster entries per frame on average, at most " << clusterLightMax << " lights in one cluster" << std::endl;
+        std::cout << "Shadow map rendered " << shadows.GetRenderedCount() << " times, reused " << shadows.GetReusedCount()
+            << ", skipped " << shadows.GetSkippedCount() << std::endl;
+        return 0;
+    }
+
+    if (!recordPath.empty() && !recorder.Open(recordPath, simulationRate, seed)) {
+        std::cerr << "Failed to open input recording: " << recordPath << std::endl;
+    }
 
-        if (currentJumping != isJumping) {
-            isJumping = currentJumping;
-            if (isJumping) {
-                soundManager.playSound(SoundManager::JUMP, 80.0f);
+    // Game logic runs on its own thread from here on and talks to this one only
+    // through the input and snapshot triple buffers.
+    PublishSnapshot(Simulation::Now());
+    Simulation simulation;
+    InputState replayPrevious;
+    simulation.Start(simulationRate, [&](const InputState& liveInput, const InputState& livePrevious, float dt, double tickTime) {
+        InputState input = liveInput;
+        InputState previous = livePrevious;
+        bool restart = restartRequested.exchange(false);
+        if (replay.IsLoaded()) {
+            previous = replayPrevious;
+            if (!replay.Next(input, restart)) {
+                replayFinished = true;
+                return;
             }
+            replayPrevious = input;
         }
+        if (recorder.IsOpen())
+            recorder.Record(input, previous, restart, tickTime);
 
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        lightingShader.setMat4("projection", projection);
-        lightingShader.setMat4("view", view);
+        if (restart)
+            RestartGame();
+        SimulationTick(input, previous, dt, collisionWorld);
+        PublishSnapshot(tickTime);
+        });
+    double runStart = Simulation::Now();
+    int renderedFrames = 0;
 
-        glBindVertexArray(modelVAO);
-        
-        RenderScene(
-            lightingShader,
-            model1,
-            model1Matrix,
-            ourModel,
-            swordMatrices,
-            batteries,
-            batteryModel,
-            flashlightModel,
-            flashlightMatrix
-        );
-        
-        lightCubeShader.use();
-        lightCubeShader.setMat4("projection", projection);
-        lightCubeShader.setMat4("view", view);
+    while (!glfwWindowShouldClose(window))
+    {
+        if (replayFinished) {
+            glfwSetWindowShouldClose(window, true);
+        }
 
+        static bool escPressedLastFrame = false;
 
-        
-        glBindVertexArray(lightCubeVAO);
-        for (unsigned int i = 0; i < 5; i++)
-        {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
-            model = glm::scale(model, glm::vec3(0.05f));
-            lightCubeShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS && !escPressedLastFrame) {
+            menu.Toggle();
+            escPressedLastFrame = true;
+        }
+        else if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_RELEASE) {
+            escPressedLastFrame = false;
         }
 
-        glDepthFunc(GL_LEQUAL);
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        if (activeFirePositions.size() == 5) {
-            skyboxShader.setBool("ActiveCubeMap", true);
+        simulation.SubmitInput(PollInput(window));
+        simulation.SetPaused(menu.IsActive());
+
+        if (menu.IsActive()) {
+            menu.ProcessInput();
+            menu.Render();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+            continue;
         }
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+
+        const FrameSnapshot& frame = snapshots.Read();
+        float alpha = glm::clamp(static_cast<float>((Simulation::Now() - frame.tickTime) / simulation.GetStep()), 0.0f, 1.0f);
+        renderFrame(frame, alpha, 0, nullptr, nullptr);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+        renderedFrames++;
     }
+    simulation.Stop();
+    recorder.Close();
+
+    if (replay.IsLoaded()) {
+        double elapsed = Simulation::Now() - runStart;
+        std::cout << "Replay: " << replay.GetTickCount() << " ticks (" << replay.GetDuration() << " s recorded) in "
+            << elapsed << " s, " << renderedFrames << " frames, "
+            << (renderedFrames > 0 ? elapsed * 1000.0 / renderedFrames : 0.0) << " ms/frame" << std::endl;
+    }
+
     glDeleteVertexArrays(1, &cubeVAO);
     glDeleteVertexArrays(1, &modelVAO);
     glDeleteVertexArrays(1, &lightCubeVAO);
@@ -752,22 +1055,36 @@ int main()
     return 0;
 }
 
-void processInput(GLFWwindow* window, std::vector<AABB>& meshesAABB)
+// Samples the keys and mouse on the window thread for the simulation thread.
+InputState PollInput(GLFWwindow* window)
 {
-    static bool escPressedLastFrame = false;
-    bool escPressedNow = glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS;
+    InputState input;
+    input.keys[KEY_FORWARD] = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    input.keys[KEY_BACKWARD] = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    input.keys[KEY_LEFT] = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    input.keys[KEY_RIGHT] = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+    input.keys[KEY_JUMP] = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+    input.keys[KEY_INTERACT] = glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS;
+    input.keys[KEY_FLASHLIGHT] = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    input.keys[KEY_NECK] = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+    input.mouseX = mouseTotalX;
+    input.mouseY = mouseTotalY;
+    return input;
+}
 
-    if (escPressedNow && !escPressedLastFrame) {
-        escPressedLastFrame = true;
-        return;
+void processInput(const InputState& input, const InputState& previous, const CollisionWorld& world, float dt)
+{
+    float xoffset = static_cast<float>(input.mouseX - previous.mouseX);
+    float yoffset = static_cast<float>(input.mouseY - previous.mouseY);
+    if (xoffset != 0.0f || yoffset != 0.0f) {
+        camera.ProcessMouseMovement(xoffset, yoffset);
     }
-    escPressedLastFrame = escPressedNow;
 
     if (!camera.neckAnimation.isActive) {
-        camera.ProcessKeyboard(FORWARD, glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS);
-        camera.ProcessKeyboard(BACKWARD, glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS);
-        camera.ProcessKeyboard(LEFT, glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS);
-        camera.ProcessKeyboard(RIGHT, glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS);
+        camera.ProcessKeyboard(FORWARD, input.keys[KEY_FORWARD]);
+        camera.ProcessKeyboard(BACKWARD, input.keys[KEY_BACKWARD]);
+        camera.ProcessKeyboard(LEFT, input.keys[KEY_LEFT]);
+        camera.ProcessKeyboard(RIGHT, input.keys[KEY_RIGHT]);
     }
     else {
         camera.moveForward = false;
@@ -777,22 +1094,171 @@ void processInput(GLFWwindow* window, std::vector<AABB>& meshesAABB)
         camera.isMoving = false;
     }
 
-    static bool spaceWasPressed = false;
-    bool spaceIsPressed = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
-    if (spaceIsPressed && !spaceWasPressed) {
+    if (input.Pressed(KEY_JUMP, previous)) {
         camera.ProcessKeyboard(JUMP, true);
     }
-    spaceWasPressed = spaceIsPressed;
 
-    flashlight.Position = glm::vec3(camera.Position.x - camera.Front.z * 2.0f,
-        camera.Position.y + 1.0f,
-        camera.Position.z + camera.Front.x * 2.0f);
-    flashlight.Position += camera.Front * 4.0f;
-    flashlight.Direction = camera.Front;
-    camera.UpdatePosition(deltaTime, meshesAABB);
+    flashlight.Follow(camera);
+    camera.UpdatePosition(dt, world);
     
-    camera.UpdateIdleAnimation(deltaTime);
-    flashlight.UpdateBattery(deltaTime);
+    camera.UpdateIdleAnimation(dt);
+    flashlight.UpdateBattery(dt);
+}
+
+// One fixed simulation step: input, movement, physics and game logic.
+void SimulationTick(const InputState& input, const InputState& previous, float dt, const CollisionWorld& world)
+{
+    camera.PreviousPosition = camera.Position;
+    simulationTime += dt;
+
+    processInput(input, previous, world, dt);
+    camera.UpdatePhysics(dt, soundManager);
+
+    if (input.Pressed(KEY_INTERACT, previous)) {
+        std::vector<int> reachable;
+        interactions.Query(camera.Position, camera.Front, LIGHT_ACTIVATION_ANGLE, reachable);
+
+        bool batteryTaken = false;
+        for (int trigger : reachable) {
+            const InteractionTrigger& target = interactions.Get(trigger);
+            int i = target.id;
+            if (target.kind == INTERACTION_BONFIRE && pointLights[i].isOn == false) {
+
+                pointLights[i].isOn = true;
+                player.RegisterFireActivation();
+                soundManager.playSound(SoundManager::BORNFIRE, 80.0f);
+                soundManager.playFireSound(pointLightPositions[i], 20.0f, true);
+                glm::vec3 newDiffuse = pointLights[i].isOn ? glm::vec3(1.0f, 0.35f, 0.0f) : glm::vec3(0.0f);
+
+                pointLights[i].diffuse = newDiffuse;
+                pointLights[i].ambient = newDiffuse;
+                pointLights[i].specular = newDiffuse;
+                interactions.SetEnabled(trigger, false);
+            }
+            else if (target.kind == INTERACTION_BATTERY && batteries[i].isActive && !batteryTaken) {
+                soundManager.playSound(SoundManager::BATTERY, 80.0f);
+                flashlight.Charge();
+                batteries[i].isActive = false;
+                interactions.SetEnabled(trigger, false);
+                batteryTaken = true;
+            }
+        }
+    }
+
+    if (input.Pressed(KEY_FLASHLIGHT, previous)) {
+        if (flashlight.State) {
+            flashlight.TurnOff();
+            soundManager.playSound(SoundManager::FLASHLIGHT, 80.0f);
+        }
+        else {
+            flashlight.TurnOn();
+            soundManager.playSound(SoundManager::FLASHLIGHT, 80.0f);
+        }
+    }
+
+    soundManager.setListenerPosition(camera.Position.x, camera.Position.y, camera.Position.z);
+    soundManager.setListenerDirection(camera.Front.x, camera.Front.y, camera.Front.z);
+
+    soundManager.updateSoundPosition(SoundManager::WALK,
+        camera.Position.x,
+        camera.Position.y - 1.0f,
+        camera.Position.z);
+
+    soundManager.updateSoundPosition(SoundManager::JUMP,
+        camera.Position.x,
+        camera.Position.y - 1.0f,
+        camera.Position.z);
+
+    std::vector<glm::vec3> activeFirePositions = GetActiveFirePositions();
+
+    soundManager.updateFireSoundPositions(activeFirePositions);
+
+    player.Update(dt, flashlight, camera, activeFirePositions);
+
+    if (player.sleepState == Player::SLEEP) {
+        float intensity = (sin(simulationTime * 10.0f) * 0.5f + 0.5f) * 0.3f + 0.2f;
+        flashlight.Diffuse = glm::vec3(intensity);
+    }
+    else if (flashlight.State) {
+        flashlight.Diffuse = glm::vec3(1.0f);
+    }
+
+    player.HandleHKeyPress(input.Pressed(KEY_NECK, previous), flashlight, camera, activeFirePositions);
+
+    bool currentlyWalking = camera.IsMoving();
+    if (currentlyWalking != isWalking) {
+        isWalking = currentlyWalking;
+        if (isWalking) {
+            soundManager.playSound(SoundManager::WALK, 70.0f, true);
+        }
+        else {
+            soundManager.stopSound(SoundManager::WALK);
+        }
+    }
+
+    bool currentJumping = camera.IsJumping;
+
+    if (currentJumping != isJumping) {
+        isJumping = currentJumping;
+        if (isJumping) {
+            soundManager.playSound(SoundManager::JUMP, 80.0f);
+        }
+    }
+}
+
+// Copies the state the renderer needs; published by the simulation thread after every tick.
+void FillSnapshot(FrameSnapshot& snapshot, double tickTime)
+{
+    snapshot.camera = camera;
+    snapshot.flashlight = flashlight;
+    snapshot.pointLights = pointLights;
+    snapshot.batteryActive.resize(batteries.size());
+    for (size_t i = 0; i < batteries.size(); i++) {
+        snapshot.batteryActive[i] = batteries[i].isActive;
+    }
+    snapshot.tickTime = tickTime;
+}
+
+void PublishSnapshot(double tickTime)
+{
+    FillSnapshot(snapshots.Write(), tickTime);
+    snapshots.Publish();
+}
+
+// Requested from the menu, applied at the start of the next simulation tick.
+void RestartGame()
+{
+    camera.SetPosition(glm::vec3(-546.0f, 7.0f, 628.0f));
+    flashlight.BatteryLevel = 100.0f;
+
+    for (PointLightState& light : pointLights) {
+        if (light.isOn) {
+            light.isOn = false;
+            light.diffuse = glm::vec3(0.0f);
+            light.ambient = glm::vec3(0.0f);
+            light.specular = glm::vec3(0.0f);
+
+            soundManager.stopAllFireSounds();
+        }
+    }
+
+    for (auto& battery : batteries) {
+        battery.isActive = true;
+    }
+    interactions.EnableAll();
+
+    player.Reset();
+}
+
+std::vector<glm::vec3> GetActiveFirePositions()
+{
+    std::vector<glm::vec3> activeFirePositions;
+    for (size_t i = 0; i < pointLights.size(); i++) {
+        if (pointLights[i].isOn) {
+            activeFirePositions.push_back(pointLightPositions[i]);
+        }
+    }
+    return activeFirePositions;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -819,7 +1285,9 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    // Applied by the simulation thread on its next tick.
+    mouseTotalX += xoffset;
+    mouseTotalY += yoffset;
 }
 
 unsigned int loadTexture(char const* path)
@@ -861,31 +1329,119 @@ unsigned int loadTexture(char const* path)
 
 
 
-void RenderScene(Shader& shader, Model& model1, const glm::mat4& model1Matrix,
-    Model& ourModel, const std::vector<glm::mat4>& swordMatrices,
-    const std::vector<Battery>& batteries, Model& batteryModel,
-    Model& flashlightModel, const glm::mat4& flashlightMatrix)
+// Sets the matrix of a non-instanced draw, plus the normal matrix that the
+// world-space lighting variants take instead of inverting per vertex.
+static void SetModelMatrix(Shader& shader, const glm::mat4& model)
 {
+    const Shader::DrawUniforms& uniforms = shader.getDrawUniforms();
+    shader.setMat4(uniforms.model, model);
+    if (uniforms.normalMatrix.location != -1)
+        shader.setMat3(uniforms.normalMatrix, glm::transpose(glm::inverse(glm::mat3(model))));
+}
 
-    shader.setMat4("model", model1Matrix);
-    model1.Draw(shader);
+// The lit pass draws each model with the cheapest lighting shader variant its
+// material maps allow; depth passes keep the shader they were given.
+static Shader& ShaderFor(SceneDraw& scene, Shader& shader, const Model& model, ScenePass pass)
+{
+    if (pass != SCENE_PASS_SHADED || !scene.lightingShaders)
+        return shader;
+    unsigned int maps = model.GetMaterialMaps();
+    unsigned int features = scene.lightingFeatures |
+        ((maps & MATERIAL_NORMAL_MAP) ? LIGHTING_NORMAL_MAP : 0) |
+        ((maps & MATERIAL_SPECULAR_MAP) ? LIGHTING_SPECULAR_MAP : 0);
+    Shader& variant = scene.lightingShaders->Get(features);
+    if (&variant != scene.currentShader) {
+        variant.use();
+        if (scene.prepareShader)
+            scene.prepareShader(variant, features);
+        scene.currentShader = &variant;
+    }
+    return variant;
+}
 
-    shader.setMat4("model", flashlightMatrix);
-    flashlightModel.Draw(shader);
+// Keeps the indices of the boxes that intersect frustum, lie in a visible cell
+// and are not hidden behind a wall.
+static size_t CullBounds(const SceneDraw& scene, const Frustum& frustum, const AABBSoA& bounds, uint32_t* indices)
+{
+    size_t count = frustum.Cull(bounds, indices);
+    if (scene.portals)
+        count = scene.portals->Filter(bounds, indices, count);
+    if (scene.occlusion)
+        count = scene.occlusion->Filter(bounds, indices, count);
+    return count;
+}
 
-    for (const auto& matrix : swordMatrices) {
-        shader.setMat4("model", matrix);
-        ourModel.Draw(shader);
-    }
+static void CullInstances(SceneDraw& scene, const Frustum& frustum, const std::vector<glm::mat4>& matrices,
+    const AABBSoA& bounds, InstanceBuffer& instances)
+{
+    size_t count = CullBounds(scene, frustum, bounds, scene.visible.data());
+    scene.visibleMatrices.clear();
+    for (size_t i = 0; i < count; i++)
+        scene.visibleMatrices.push_back(matrices[scene.visible[i]]);
+    instances.Upload(scene.visibleMatrices);
+}
 
-    for (const auto& battery : batteries) {
-        if (battery.isActive) {
-            for (const auto& matrix : battery.matrices) {
-                shader.setMat4("model", matrix);
-                batteryModel.Draw(shader);
-            }
-        }
+// Culls everything RenderScene draws once, for all passes that share frustum
+// until the next call.
+void CullScene(SceneDraw& scene, const Frustum& frustum)
+{
+    size_t largest = std::max(scene.swordBounds.Size(), scene.batteryBounds.Size());
+    if (scene.visible.size() < largest)
+        scene.visible.resize(largest);
+    if (scene.visibleLevel.size() < scene.levelBounds.Size())
+        scene.visibleLevel.resize(scene.levelBounds.Size());
+
+    scene.visibleLevelCount = CullBounds(scene, frustum, scene.levelBounds, scene.visibleLevel.data());
+    CullInstances(scene, frustum, scene.swordMatrices, scene.swordBounds, scene.swordInstances);
+    CullInstances(scene, frustum, scene.batteryMatrices, scene.batteryBounds, scene.batteryInstances);
+}
+
+// Draws the instances the last CullScene kept, as one instanced draw per mesh.
+static void DrawVisibleInstances(Shader& shader, SceneDraw& scene, Model& model, InstanceBuffer& instances, ScenePass pass)
+{
+    Shader& drawShader = ShaderFor(scene, shader, model, pass);
+    const Shader::Uniform instanced = drawShader.getDrawUniforms().instanced;
+    drawShader.setBool(instanced, true);
+    if (pass == SCENE_PASS_SHADED)
+        model.DrawInstanced(drawShader, instances);
+    else
+        model.DrawDepthInstanced(drawShader, instances);
+    drawShader.setBool(instanced, false);
+}
+
+// Draws what the last CullScene kept. eye is where the pass looks from; level
+// meshlets facing away from it are skipped.
+void RenderScene(Shader& shader, SceneDraw& scene, const Frustum& frustum, const glm::vec3& eye, ScenePass pass)
+{
+    bool depthOnly = pass != SCENE_PASS_SHADED;
+    if (depthOnly)
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    scene.currentShader = nullptr;
+
+    glm::vec3 levelEye = glm::vec3(glm::inverse(scene.levelMatrix) * glm::vec4(eye, 1.0f));
+    Shader& levelShader = ShaderFor(scene, shader, *scene.level, pass);
+    SetModelMatrix(levelShader, scene.levelMatrix);
+    if (depthOnly)
+        scene.level->DrawDepth(levelShader, scene.visibleLevel.data(), scene.visibleLevelCount, levelEye);
+    else
+        scene.level->Draw(levelShader, scene.visibleLevel.data(), scene.visibleLevelCount, levelEye);
+
+    if (pass != SCENE_PASS_SHADOW && frustum.Intersects(Transform(scene.flashlight->GetAABB(), scene.flashlightMatrix))) {
+        Shader& flashlightShader = ShaderFor(scene, shader, *scene.flashlight, pass);
+        SetModelMatrix(flashlightShader, scene.flashlightMatrix);
+        if (depthOnly)
+            scene.flashlight->DrawDepth(flashlightShader);
+        else
+            scene.flashlight->Draw(flashlightShader);
     }
+
+    // Props repeated across the level are drawn with one call per mesh.
+    DrawVisibleInstances(shader, scene, *scene.sword, scene.swordInstances, pass);
+    DrawVisibleInstances(shader, scene, *scene.battery, scene.batteryInstances, pass);
+
+    if (depthOnly)
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
 unsigned int loadCubemap(vector<std::string> faces)
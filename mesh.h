@@ -8,21 +8,20 @@
 
 #include "Shader.h"
 #include "AABB.h"
+#include "Meshlet.h"
 
 #include <string>
 #include <vector>
 using namespace std;
 
-#define MAX_BONE_INFLUENCE 4
-
+// CPU copy of a vertex. The bitangent is rebuilt in the shader as
+// cross(Normal, Tangent) * TangentSign.
 struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    float m_Weights[MAX_BONE_INFLUENCE];
+    glm::vec3 Position = glm::vec3(0.0f);
+    glm::vec3 Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec2 TexCoords = glm::vec2(0.0f);
+    glm::vec3 Tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+    float TangentSign = 1.0f;
 };
 
 struct Texture {
@@ -31,54 +30,108 @@ struct Texture {
     string path;
 };
 
+// Units the lighting shader reads a mesh's first diffuse, specular and normal
+// map from.
+enum MaterialTextureUnit {
+    DIFFUSE_MAP_UNIT,
+    SPECULAR_MAP_UNIT,
+    NORMAL_MAP_UNIT,
+    MATERIAL_UNIT_COUNT
+};
+
+// Optional maps present on a mesh, as a bit mask.
+enum MaterialMaps {
+    MATERIAL_SPECULAR_MAP = 1,
+    MATERIAL_NORMAL_MAP = 2
+};
+
+// 1x1 stand-ins for maps a mesh lacks: white diffuse, black specular, flat normal.
+inline unsigned int FallbackTexture(MaterialTextureUnit unit)
+{
+    static unsigned int textures[MATERIAL_UNIT_COUNT] = {};
+    static const unsigned char texels[MATERIAL_UNIT_COUNT][4] = {
+        { 255, 255, 255, 255 }, { 0, 0, 0, 255 }, { 128, 128, 255, 255 }
+    };
+    if (textures[unit] == 0) {
+        glGenTextures(1, &textures[unit]);
+        glBindTexture(GL_TEXTURE_2D, textures[unit]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels[unit]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    return textures[unit];
+}
+
+// A sub-range of its Model's shared vertex and index buffers. The owning
+// Model binds the VAO; a Mesh only binds its textures and issues the draw.
 class Mesh {
 public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
+    unsigned int baseVertex = 0;    // first vertex in the model's vertex buffer
+    size_t indexOffset = 0;         // byte offset of the first index in the model's index buffer
+    GLenum indexType = GL_UNSIGNED_INT;
+    vector<Meshlet> meshlets;       // empty for meshes that are always drawn whole
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
-        setupMesh();
+        setupMaterial();
     }
 
-    // render the mesh
-    void Draw(Shader& shader)
+    // render the mesh; the model's VAO must be bound
+    void Draw()
     {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr = 1;
-        unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++);
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++);
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++);
-
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        bindTextures();
+        DrawGeometry();
+    }
+
+    // render only the meshlets that can face viewer (in model space); adjacent
+    // survivors are merged into one range of a single multi-draw
+    void Draw(const glm::vec3& viewer)
+    {
+        if (meshlets.empty()) {
+            Draw();
+            return;
         }
+        if (!collectMeshlets(viewer))
+            return;
+        bindTextures();
+        drawMeshlets();
+    }
+
+    // render instanceCount copies; the model's VAO must be bound with instance matrices attached
+    void DrawInstanced(GLsizei instanceCount)
+    {
+        bindTextures();
+        DrawGeometryInstanced(instanceCount);
+    }
+
+    // The same draws without binding textures, for depth-only passes.
+    void DrawGeometry()
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), indexType,
+            (void*)indexOffset, baseVertex);
+    }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    void DrawGeometry(const glm::vec3& viewer)
+    {
+        if (meshlets.empty())
+            DrawGeometry();
+        else if (collectMeshlets(viewer))
+            drawMeshlets();
+    }
 
-        glActiveTexture(GL_TEXTURE0);
+    void DrawGeometryInstanced(GLsizei instanceCount)
+    {
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), indexType,
+            (void*)indexOffset, instanceCount, baseVertex);
     }
 
     AABB GetAABB() const { return aabb; }
+    unsigned int GetMaterialMaps() const { return materialMaps; }
 
     void CalculateAABB() {
         aabb.min = glm::vec3(FLT_MAX);
@@ -93,36 +146,72 @@ private:
 
     AABB aabb;
 
-    unsigned int VBO, EBO;
+    // Texture bound to each material unit, 0 where the mesh has none.
+    unsigned int materialTextures[MATERIAL_UNIT_COUNT] = {};
+    unsigned int materialMaps = 0;
+
+    // Scratch for the meshlet multi-draw.
+    vector<GLsizei> drawCounts;
+    vector<const void*> drawOffsets;
+    vector<GLint> drawBaseVertices;
+
+    // Fills the multi-draw scratch with the meshlets that can face viewer;
+    // false when none can.
+    bool collectMeshlets(const glm::vec3& viewer)
+    {
+        drawCounts.clear();
+        drawOffsets.clear();
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+        unsigned int rangeEnd = ~0u;
+        for (const Meshlet& meshlet : meshlets) {
+            if (meshlet.FacesAway(viewer))
+                continue;
+            if (meshlet.firstIndex == rangeEnd)
+                drawCounts.back() += meshlet.indexCount;
+            else {
+                drawCounts.push_back(meshlet.indexCount);
+                drawOffsets.push_back((const void*)(indexOffset + meshlet.firstIndex * indexSize));
+            }
+            rangeEnd = meshlet.firstIndex + meshlet.indexCount;
+        }
+        return !drawCounts.empty();
+    }
+
+    void drawMeshlets()
+    {
+        drawBaseVertices.assign(drawCounts.size(), static_cast<GLint>(baseVertex));
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType, drawOffsets.data(),
+            static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
+    }
 
-    void setupMesh()
+    // Every unit is bound, with a stand-in where the mesh has no map, so a
+    // draw never samples whatever the previous mesh left there.
+    void bindTextures()
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-        glEnableVertexAttribArray(5);
-        glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+        for (int unit = 0; unit < MATERIAL_UNIT_COUNT; unit++)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            unsigned int texture = materialTextures[unit];
+            glBindTexture(GL_TEXTURE_2D, texture != 0 ? texture : FallbackTexture(static_cast<MaterialTextureUnit>(unit)));
+        }
+    }
+
+    void setupMaterial()
+    {
+        for (const Texture& texture : textures)
+        {
+            int unit = -1;
+            if (texture.type == "texture_diffuse")
+                unit = DIFFUSE_MAP_UNIT;
+            else if (texture.type == "texture_specular")
+                unit = SPECULAR_MAP_UNIT;
+            else if (texture.type == "texture_normal")
+                unit = NORMAL_MAP_UNIT;
+            if (unit >= 0 && materialTextures[unit] == 0)
+                materialTextures[unit] = texture.id;
+        }
+        materialMaps = (materialTextures[SPECULAR_MAP_UNIT] != 0 ? MATERIAL_SPECULAR_MAP : 0) |
+            (materialTextures[NORMAL_MAP_UNIT] != 0 ? MATERIAL_NORMAL_MAP : 0);
     }
 };
-#endif
\ No newline at end of file
+#endif
@@ -13,6 +13,11 @@
 #include "mesh.h"
 #include "Shader.h"
 #include "AABB.h"
+#include "AABBSoA.h"
+#include "InstanceBuffer.h"
+#include "VertexFormat.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
 
 #include <string>
 #include <fstream>
@@ -20,6 +25,7 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <cstdio>
 using namespace std;
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
@@ -32,15 +38,86 @@ public:
     string directory;
     bool gammaCorrection;
 
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    // preferredFormat is a request: packed vertices fall back to float when
+    // 16 bits over the whole model would be too coarse for its smallest mesh.
+    Model(string const& path, bool gamma = false, VertexFormat preferredFormat = VERTEX_FORMAT_PACKED)
+        : gammaCorrection(gamma), vertexFormat(preferredFormat)
     {
         loadModel(path);
     }
 
     void Draw(Shader& shader)
     {
+        glBindVertexArray(VAO);
+        bindVertexFormat(shader);
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw();
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    // Draws only the meshes whose indices are listed in visible, skipping
+    // meshlets that face away from viewer (in model space).
+    void Draw(Shader& shader, const uint32_t* visible, size_t visibleCount, const glm::vec3& viewer)
+    {
+        if (visibleCount == 0)
+            return;
+        glBindVertexArray(VAO);
+        bindVertexFormat(shader);
+        for (size_t i = 0; i < visibleCount; i++)
+            meshes[visible[i]].Draw(viewer);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    void DrawInstanced(Shader& shader, const InstanceBuffer& instances)
+    {
+        if (instances.count == 0)
+            return;
+        if (instanceBuffer != instances.buffer) {
+            instances.AttachTo(VAO);
+            instanceBuffer = instances.buffer;
+        }
+        glBindVertexArray(VAO);
+        bindVertexFormat(shader);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawInstanced(instances.count);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Depth-only counterparts of the draws above. They read the position-only
+    // stream and bind no textures; shader only needs location 0 and the
+    // position dequantization uniforms.
+    void DrawDepth(Shader& shader)
+    {
+        glBindVertexArray(depthVAO);
+        bindVertexFormat(shader);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawGeometry();
+        glBindVertexArray(0);
+    }
+    void DrawDepth(Shader& shader, const uint32_t* visible, size_t visibleCount, const glm::vec3& viewer)
+    {
+        if (visibleCount == 0)
+            return;
+        glBindVertexArray(depthVAO);
+        bindVertexFormat(shader);
+        for (size_t i = 0; i < visibleCount; i++)
+            meshes[visible[i]].DrawGeometry(viewer);
+        glBindVertexArray(0);
+    }
+    void DrawDepthInstanced(Shader& shader, const InstanceBuffer& instances)
+    {
+        if (instances.count == 0)
+            return;
+        if (depthInstanceBuffer != instances.buffer) {
+            instances.AttachTo(depthVAO);
+            depthInstanceBuffer = instances.buffer;
+        }
+        glBindVertexArray(depthVAO);
+        bindVertexFormat(shader);
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawGeometryInstanced(instances.count);
+        glBindVertexArray(0);
     }
     std::vector<AABB> GetMeshesAABB(const glm::vec3& scale, const glm::vec3& position) const {
         std::vector<AABB> meshesAABB;
@@ -54,42 +131,193 @@ public:
 
         return meshesAABB;
     }
+    // World-space box of every mesh under matrix, in mesh order.
+    void GetMeshBounds(const glm::mat4& matrix, AABBSoA& bounds) const {
+        bounds.Clear();
+        for (const auto& mesh : meshes)
+            bounds.Add(Transform(mesh.GetAABB(), matrix));
+    }
+    AABB GetAABB() const { return aabb; }
+    VertexFormat GetVertexFormat() const { return vertexFormat; }
+    // Maps any mesh has; meshes missing one draw with a neutral stand-in.
+    unsigned int GetMaterialMaps() const { return materialMaps; }
+    std::vector<glm::vec3> GetTriangles(const glm::mat4& matrix) const {
+        std::vector<glm::vec3> corners;
+
+        for (const auto& mesh : meshes) {
+            for (unsigned int index : mesh.indices) {
+                corners.push_back(glm::vec3(matrix * glm::vec4(mesh.vertices[index].Position, 1.0f)));
+            }
+        }
+
+        return corners;
+    }
 
 private:
     AABB aabb;
 
-    void CalculateAABB(const aiScene* scene) {
+    // All meshes share one vertex buffer, one index buffer and one VAO.
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    unsigned int instanceBuffer = 0;    // instance matrices currently attached to VAO
+    // Positions alone for depth passes, drawn with the same EBO.
+    unsigned int depthVAO = 0, depthVBO = 0;
+    unsigned int depthInstanceBuffer = 0;
+
+    VertexFormat vertexFormat;
+    VertexQuantization quantization;
+    unsigned int materialMaps = 0;
+
+    // Meshes with fewer triangles are drawn whole; splitting them saves less than the extra ranges cost.
+    static const size_t MESHLET_MIN_TRIANGLES = 4 * Meshlet::MAX_TRIANGLES;
+
+    // Fewest 16-bit steps any single mesh may span before the model falls back to float.
+    static constexpr float MIN_MESH_STEPS = 1024.0f;
+
+    VertexFormat chooseVertexFormat(VertexFormat preferred) const
+    {
+        if (preferred != VERTEX_FORMAT_PACKED)
+            return preferred;
+        glm::vec3 modelSize = aabb.max - aabb.min;
+        float step = std::max(modelSize.x, std::max(modelSize.y, modelSize.z)) / 65535.0f;
+        for (const auto& mesh : meshes) {
+            glm::vec3 size = mesh.GetAABB().max - mesh.GetAABB().min;
+            float extent = std::max(size.x, std::max(size.y, size.z));
+            if (extent > 0.0f && step * MIN_MESH_STEPS > extent)
+                return VERTEX_FORMAT_FLOAT;
+        }
+        return VERTEX_FORMAT_PACKED;
+    }
+
+    // The shaders map stored positions and UVs back to model space with these.
+    void bindVertexFormat(Shader& shader) const
+    {
+        const Shader::DrawUniforms& uniforms = shader.getDrawUniforms();
+        shader.setVec3(uniforms.positionOffset, quantization.positionOffset);
+        shader.setVec3(uniforms.positionScale, quantization.positionScale);
+        shader.setVec4(uniforms.texCoordRange, quantization.texCoordOffset.x, quantization.texCoordOffset.y,
+            quantization.texCoordScale.x, quantization.texCoordScale.y);
+    }
+
+    void CalculateAABB() {
         aabb.min = glm::vec3(FLT_MAX);
         aabb.max = glm::vec3(-FLT_MAX);
 
-        for (unsigned int i = 0; i < scene->mNumMeshes; i++) {
-            aiMesh* mesh = scene->mMeshes[i];
-            for (unsigned int j = 0; j < mesh->mNumVertices; j++) {
-                glm::vec3 vertex(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
-                aabb.min = glm::min(aabb.min, vertex);
-                aabb.max = glm::max(aabb.max, vertex);
-            }
+        for (const auto& mesh : meshes) {
+            aabb.min = glm::min(aabb.min, mesh.GetAABB().min);
+            aabb.max = glm::max(aabb.max, mesh.GetAABB().max);
         }
     }
 
 
+    // Meshes come from "<path>.cache" when it matches the source files. Otherwise
+    // the file is imported, every mesh goes through the optimization pipeline
+    // and the cache is written for the next launch.
     void loadModel(string const& path)
     {
+        directory = path.substr(0, path.find_last_of('/'));
+        string cachePath = path + ".cache";
+        MeshCacheKey key;
+        bool keyed = MeshCache::MakeKey(path, key);
+
+        vector<CachedMesh> cached;
+        if (keyed && MeshCache::Load(cachePath, key, cached)) {
+            for (auto& mesh : cached) {
+                for (auto& texture : mesh.textures)
+                    texture = loadTexture(texture.path, texture.type);
+                Mesh result(mesh.vertices, mesh.indices, mesh.textures);
+                result.CalculateAABB();
+                meshes.push_back(result);
+            }
+        }
+        else {
+            Assimp::Importer importer;
+            const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return;
+            }
 
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+            cout << "Building mesh cache for " << path << endl;
+            processNode(scene->mRootNode, scene);
+            if (!MeshCache::Save(cachePath, key, meshes))
+                cout << "Failed to write mesh cache " << cachePath << endl;
+        }
 
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+        CalculateAABB();
+        setupBuffers();
+    }
+
+    // Packs every mesh into the shared buffers; meshes keep their own indices
+    // and are offset by baseVertex at draw time. Indices are 16-bit for every
+    // mesh that has few enough vertices, and each mesh starts 4-byte aligned.
+    void setupBuffers()
+    {
+        size_t vertexCount = 0, indexBytes = 0;
+        for (auto& mesh : meshes) {
+            materialMaps |= mesh.GetMaterialMaps();
+            mesh.baseVertex = static_cast<unsigned int>(vertexCount);
+            mesh.indexType = mesh.vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            mesh.indexOffset = (indexBytes + 3) & ~size_t(3);
+            vertexCount += mesh.vertices.size();
+            indexBytes = mesh.indexOffset + mesh.indices.size() * (mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+            if (mesh.indices.size() / 3 >= MESHLET_MIN_TRIANGLES)
+                mesh.meshlets = BuildMeshlets(mesh.vertices, mesh.indices);
         }
 
-        directory = path.substr(0, path.find_last_of('/'));
+        std::vector<unsigned char> indexData(indexBytes);
+        for (const auto& mesh : meshes) {
+            if (mesh.indexType == GL_UNSIGNED_INT) {
+                if (!mesh.indices.empty())
+                    std::memcpy(&indexData[mesh.indexOffset], &mesh.indices[0], mesh.indices.size() * sizeof(unsigned int));
+                continue;
+            }
+            unsigned short* narrow = reinterpret_cast<unsigned short*>(indexData.data() + mesh.indexOffset);
+            for (size_t i = 0; i < mesh.indices.size(); i++)
+                narrow[i] = static_cast<unsigned short>(mesh.indices[i]);
+        }
 
+        vertexFormat = chooseVertexFormat(vertexFormat);
+        if (vertexFormat == VERTEX_FORMAT_PACKED) {
+            glm::vec2 texCoordMin(FLT_MAX), texCoordMax(-FLT_MAX);
+            for (const auto& mesh : meshes)
+                for (const auto& vertex : mesh.vertices) {
+                    texCoordMin = glm::min(texCoordMin, vertex.TexCoords);
+                    texCoordMax = glm::max(texCoordMax, vertex.TexCoords);
+                }
+            if (vertexCount > 0)
+                quantization = QuantizationFor(aabb, texCoordMin, texCoordMax);
+        }
+        std::vector<unsigned char> vertexData;
+        vertexData.reserve(vertexCount * VertexStride(vertexFormat));
+        std::vector<unsigned char> positionData;
+        positionData.reserve(vertexCount * PositionStride(vertexFormat));
+        for (const auto& mesh : meshes) {
+            PackVertices(mesh.vertices, vertexFormat, quantization, vertexData);
+            PackPositions(mesh.vertices, vertexFormat, quantization, positionData);
+        }
 
-        processNode(scene->mRootNode, scene);
-        CalculateAABB(scene);
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.empty() ? NULL : &vertexData[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size(), indexData.empty() ? NULL : &indexData[0], GL_STATIC_DRAW);
+
+        SetupVertexAttributes(vertexFormat);
+
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &depthVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+        glBufferData(GL_ARRAY_BUFFER, positionData.size(), positionData.empty() ? NULL : &positionData[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        SetupPositionAttribute(vertexFormat);
+        glBindVertexArray(0);
     }
 
     void processNode(aiNode* node, const aiScene* scene)
@@ -139,10 +367,9 @@ private:
                 vector.z = mesh->mTangents[i].z;
                 vertex.Tangent = vector;
 
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
+                // Only the handedness of the bitangent is kept.
+                glm::vec3 bitangent(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
+                vertex.TangentSign = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
@@ -157,6 +384,11 @@ private:
                 indices.push_back(face.mIndices[j]);
         }
 
+        MeshOptimizationReport report = OptimizeMesh(vertices, indices);
+        std::printf("  %-24s %7zu triangles, vertices %7zu -> %7zu, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+            mesh->mName.C_Str(), report.triangles, report.verticesBefore, report.verticesAfter,
+            report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr);
+
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
 
         vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
@@ -184,29 +416,26 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true;
-                    break;
-                }
-            }
-            if (!skip)
-            {   
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture); 
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // Loads each texture file once per model; later requests share the first one.
+    Texture loadTexture(const string& path, const string& typeName)
+    {
+        for (unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if (textures_loaded[j].path == path)
+                return textures_loaded[j];
+        }
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);
+        return texture;
+    }
 };
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma)